@@ -3,8 +3,22 @@ CONFIG += c++11
 DEFINES += QT_DEPRECATED_WARNINGS
 
 SOURCES += \
+        compositor_telemetry.cpp \
+        dynamic_resolution.cpp \
+        frame_profiler.cpp \
         image_view.cpp \
         main.cpp \
+        mirror_readback.cpp \
+        mirror_view.cpp \
+        mock_vr_backend.cpp \
+        openvr_backend.cpp \
+        primitive_cache.cpp \
+        shader_variants.cpp \
+        sprite_atlas.cpp \
+        target_renderer.cpp \
+        texture_cache.cpp \
+        uniform_block.cpp \
+        vr_backend.cpp \
         vr_render.cpp
 
 RESOURCES += \
@@ -22,7 +36,22 @@ else: unix:!android: target.path = /opt/$${TARGET}/bin
 !isEmpty(target.path): INSTALLS += target
 
 HEADERS += \
+    compositor_telemetry.h \
+    dynamic_resolution.h \
+    frame_profiler.h \
     image_view.h \
+    mirror_readback.h \
+    mirror_view.h \
+    mock_vr_backend.h \
+    openvr_backend.h \
+    primitive_cache.h \
+    shader_variants.h \
+    sprite_atlas.h \
+    target_renderer.h \
+    texture_cache.h \
+    triple_buffer.h \
+    uniform_block.h \
+    vr_backend.h \
     vr_render.h
 
 INCLUDEPATH += $$PWD/openvr/headers
@@ -39,3 +68,9 @@ win32 {
     openvr.path = $$DESTDIR
     COPIES += openvr
 }
+unix:!macx {
+    # the runtime library ships in the tree; the rpath lets the mock/headless loop run from the build directory
+    LIBS += -L$$PWD/openvr/bin/linux64/ \
+            -lopenvr_api
+    QMAKE_RPATHDIR += $$PWD/openvr/bin/linux64
+}
@@ -0,0 +1,120 @@
+﻿#include <QtMath>
+#include "compositor_telemetry.h"
+
+CompositorTelemetry::CompositorTelemetry()
+    : m_cumulative()
+    ,m_lastIndex(0)
+    ,m_hasLastIndex(false)
+    ,m_timings(0)
+    ,m_poseHorizonMs(-1.0f)
+{
+}
+
+/**
+ * 以本帧应当上屏的垂直同步计数记录应用帧号, 批量拉取时与合成器帧号对应
+ **/
+void CompositorTelemetry::frameSubmitted(VRBackend *backend, quint64 appFrame)
+{
+    float sinceVsync = 0.0f;
+    uint64_t vsyncFrame = 0;
+    if (!backend->timeSinceLastVsync(&sinceVsync, &vsyncFrame))
+        return;
+
+    // submitted during this vsync interval, composited at the next one
+    m_appFrames.insert(quint32(vsyncFrame + 1), appFrame);
+    // correlation is only needed until the batch pull has seen the frame
+    while (m_appFrames.size() > TIMING_BATCH * 4)
+        m_appFrames.erase(m_appFrames.begin());
+}
+
+/**
+ * 位姿预测时长(采样到预计上屏)的平滑值, 为预测量而非实测延迟
+ **/
+void CompositorTelemetry::posePredicted(float secondsToPhotons)
+{
+    const float ms = secondsToPhotons * 1000.0f;
+    m_poseHorizonMs = m_poseHorizonMs < 0.0f ? ms : m_poseHorizonMs + (ms - m_poseHorizonMs) * 0.05f;
+}
+
+void CompositorTelemetry::pull(VRBackend *backend)
+{
+    m_batch[0].m_nSize = sizeof(vr::Compositor_FrameTiming);
+    const uint32_t count = backend->frameTimings(m_batch, TIMING_BATCH);
+    for (uint32_t i = 0; i < count; ++i) {
+        const vr::Compositor_FrameTiming &timing = m_batch[i];
+        // entries are oldest first; skip what the previous pull already saw
+        if (m_hasLastIndex && timing.m_nFrameIndex <= m_lastIndex)
+            continue;
+        account(timing);
+        m_lastIndex = timing.m_nFrameIndex;
+        m_hasLastIndex = true;
+    }
+
+    backend->cumulativeStats(&m_cumulative);
+
+    while (!m_histogram.isEmpty() && m_histogram.lastKey() - m_histogram.firstKey() >= HISTOGRAM_SECONDS)
+        m_histogram.erase(m_histogram.begin());
+}
+
+void CompositorTelemetry::account(const vr::Compositor_FrameTiming &timing)
+{
+    const bool missed = timing.m_nNumMisPresented > 0;
+    const bool reprojected = timing.m_nNumFramePresents > 1 ||
+            (timing.m_nReprojectionFlags & (vr::VRCompositor_ReprojectionReason_Cpu |
+                                            vr::VRCompositor_ReprojectionReason_Gpu));
+    const bool dropped = timing.m_nNumDroppedFrames > 0;
+
+    Bucket &bucket = m_histogram[qFloor(timing.m_flSystemTimeInSeconds)];
+    bucket.frames += 1;
+    bucket.missed += missed ? 1 : 0;
+    bucket.reprojected += reprojected ? 1 : 0;
+    bucket.dropped += dropped ? 1 : 0;
+    m_timings += 1;
+
+    if (missed || dropped) {
+        // 0: no submitted app frame was due at this vsync
+        m_recentMisses.append(m_appFrames.value(timing.m_nFrameIndex, 0));
+        if (m_recentMisses.size() > RECENT_MISSES)
+            m_recentMisses.removeFirst();
+    }
+    m_appFrames.remove(timing.m_nFrameIndex);
+}
+
+QVariantMap CompositorTelemetry::snapshot() const
+{
+    QVariantList histogram;
+    Bucket window;
+    for (auto it = m_histogram.constBegin(); it != m_histogram.constEnd(); ++it) {
+        QVariantMap entry;
+        entry["second"] = it.key();
+        entry["frames"] = it->frames;
+        entry["missed"] = it->missed;
+        entry["reprojected"] = it->reprojected;
+        entry["dropped"] = it->dropped;
+        histogram.append(entry);
+
+        window.frames += it->frames;
+        window.missed += it->missed;
+        window.reprojected += it->reprojected;
+        window.dropped += it->dropped;
+    }
+
+    QVariantList recentMisses;
+    for (quint64 frame : m_recentMisses)
+        recentMisses.append(frame);
+
+    QVariantMap stats;
+    stats["histogram"] = histogram;
+    stats["windowFrames"] = window.frames;
+    stats["windowMissed"] = window.missed;
+    stats["windowReprojected"] = window.reprojected;
+    stats["windowDropped"] = window.dropped;
+    stats["recentMissedAppFrames"] = recentMisses;
+    stats["timingsSeen"] = m_timings;
+    stats["predictedPoseHorizonMs"] = qMax(0.0f, m_poseHorizonMs);
+    stats["totalPresents"] = m_cumulative.m_nNumFramePresents;
+    stats["totalDropped"] = m_cumulative.m_nNumDroppedFrames;
+    stats["totalReprojected"] = m_cumulative.m_nNumReprojectedFrames;
+    stats["totalTimedOut"] = m_cumulative.m_nNumTimedOut;
+    return stats;
+}
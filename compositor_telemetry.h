@@ -0,0 +1,61 @@
+﻿#ifndef COMPOSITORTELEMETRY_H
+#define COMPOSITORTELEMETRY_H
+
+#include <QMap>
+#include <QVariantMap>
+#include <QVector>
+#include "vr_backend.h"
+
+/**
+ * 合成器帧统计
+ * Pulls Compositor_FrameTiming in batches and Compositor_CumulativeStats
+ * periodically and keeps a per-second rolling histogram of presented, missed,
+ * reprojected and dropped frames. Each submitted VRRender frame is keyed by
+ * the vsync it is due at (the last vsync counter + 1) and matched to the
+ * compositor frame with that index when the batch comes in. In
+ * recentMissedAppFrames, 0 means no app frame matched the missed frame, not
+ * app frame 0.
+ **/
+class CompositorTelemetry
+{
+public:
+    CompositorTelemetry();
+
+    // once per frame on the render thread, after both eyes were submitted; no timing query,
+    // the frame is keyed by the vsync it is due at and matched up in pull()
+    void frameSubmitted(VRBackend *backend, quint64 appFrame);
+
+    // how far ahead the pose a frame was rendered with was predicted; the app's own
+    // vsync-to-photons estimate, not a measured motion-to-photon latency
+    void posePredicted(float secondsToPhotons);
+
+    // called every few frames; cheap enough to run a few times per second
+    void pull(VRBackend *backend);
+
+    QVariantMap snapshot() const;
+
+private:
+    enum { TIMING_BATCH = 64, HISTOGRAM_SECONDS = 60, RECENT_MISSES = 32 };
+
+    struct Bucket
+    {
+        quint32 frames = 0;
+        quint32 missed = 0;
+        quint32 reprojected = 0;
+        quint32 dropped = 0;
+    };
+
+    void account(const vr::Compositor_FrameTiming &timing);
+
+    vr::Compositor_FrameTiming m_batch[TIMING_BATCH];
+    vr::Compositor_CumulativeStats m_cumulative;
+    QMap<quint32, quint64> m_appFrames;
+    QMap<qint64, Bucket> m_histogram;
+    QVector<quint64> m_recentMisses;
+    quint32 m_lastIndex;
+    bool m_hasLastIndex;
+    quint64 m_timings;
+    float m_poseHorizonMs;
+};
+
+#endif // COMPOSITORTELEMETRY_H
@@ -0,0 +1,90 @@
+﻿#include <QtMath>
+#include "dynamic_resolution.h"
+
+// share of the vsync interval the eye passes may use, the rest is left to the compositor
+const float GPU_HEADROOM = 0.85f;
+// frames averaged before each adjustment, longer than the timer query latency
+const int ADJUST_INTERVAL = 8;
+// below this share of the budget the scale is allowed to grow
+const float GROW_THRESHOLD = 0.8f;
+const float MAX_SHRINK_STEP = 0.8f;
+const float MAX_GROW_STEP = 1.05f;
+// scale granularity, avoids reallocating mirror buffers for tiny changes
+const float SCALE_STEP = 1.0f / 32.0f;
+
+DynamicResolution::DynamicResolution()
+    : m_budgetMs(1000.0f / 90.0f * GPU_HEADROOM)
+    ,m_minScale(0.5f)
+    ,m_maxScale(1.0f)
+    ,m_scale(1.0f)
+    ,m_gpuSum(0.0f)
+    ,m_samples(0)
+{
+}
+
+void DynamicResolution::setRefreshRate(float refreshRate)
+{
+    if (refreshRate > 0.0f)
+        m_budgetMs = 1000.0f / refreshRate * GPU_HEADROOM;
+}
+
+void DynamicResolution::setRange(float minScale, float maxScale)
+{
+    m_minScale = qMin(minScale, maxScale);
+    m_maxScale = qMax(minScale, maxScale);
+    m_scale = qBound(m_minScale, m_scale, m_maxScale);
+}
+
+void DynamicResolution::reset(float scale)
+{
+    m_scale = qBound(m_minScale, scale, m_maxScale);
+    m_gpuSum = 0.0f;
+    m_samples = 0;
+}
+
+/**
+ * 像素数与缩放的平方成正比, 按sqrt(预算/耗时)调整
+ **/
+float DynamicResolution::update(float gpuMs)
+{
+    if (gpuMs <= 0.0f)
+        return m_scale;
+
+    m_gpuSum += gpuMs;
+    if (++m_samples < ADJUST_INTERVAL)
+        return m_scale;
+
+    const float average = m_gpuSum / m_samples;
+    m_gpuSum = 0.0f;
+    m_samples = 0;
+
+    float factor = 1.0f;
+    if (average > m_budgetMs)
+        factor = qMax(MAX_SHRINK_STEP, qSqrt(m_budgetMs / average));
+    else if (average < m_budgetMs * GROW_THRESHOLD)
+        factor = qMin(MAX_GROW_STEP, qSqrt(m_budgetMs * GROW_THRESHOLD / average));
+
+    const float scale = qRound(m_scale * factor / SCALE_STEP) * SCALE_STEP;
+    m_scale = qBound(m_minScale, scale, m_maxScale);
+    return m_scale;
+}
+
+float DynamicResolution::scale() const
+{
+    return m_scale;
+}
+
+float DynamicResolution::budgetMs() const
+{
+    return m_budgetMs;
+}
+
+float DynamicResolution::minScale() const
+{
+    return m_minScale;
+}
+
+float DynamicResolution::maxScale() const
+{
+    return m_maxScale;
+}
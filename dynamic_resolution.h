@@ -0,0 +1,38 @@
+﻿#ifndef DYNAMICRESOLUTION_H
+#define DYNAMICRESOLUTION_H
+
+/**
+ * 动态分辨率控制
+ * Picks the per-axis render scale from the measured GPU time of the eye
+ * passes against the display's frame budget. Timer results arrive a few
+ * frames late, so the scale is only re-evaluated once per interval from
+ * the interval's average: it drops quickly when over budget and climbs
+ * back slowly, which keeps it from oscillating around the limit.
+ **/
+class DynamicResolution
+{
+public:
+    DynamicResolution();
+
+    void setRefreshRate(float refreshRate);
+    void setRange(float minScale, float maxScale);
+    void reset(float scale = 1.0f);
+
+    // call once per frame with the latest GPU time, returns the scale for the next frame
+    float update(float gpuMs);
+
+    float scale() const;
+    float budgetMs() const;
+    float minScale() const;
+    float maxScale() const;
+
+private:
+    float m_budgetMs;
+    float m_minScale;
+    float m_maxScale;
+    float m_scale;
+    float m_gpuSum;
+    int m_samples;
+};
+
+#endif // DYNAMICRESOLUTION_H
@@ -0,0 +1,191 @@
+﻿#include <algorithm>
+#include <QDebug>
+#include "frame_profiler.h"
+
+FrameProfiler::FrameProfiler()
+    : m_slot(0)
+    ,m_gpuTiming(false)
+{
+    m_clock.start();
+}
+
+FrameProfiler::~FrameProfiler()
+{
+    // queries must be released by the owner while its context is current
+}
+
+void FrameProfiler::init()
+{
+    m_gpuTiming = true;
+    for (StageData &stage : m_stages) {
+        for (int i = 0; i < QUERY_RING; ++i) {
+            stage.queries[i] = new QOpenGLTimerQuery;
+            if (!stage.queries[i]->create())
+                m_gpuTiming = false;
+        }
+    }
+    if (!m_gpuTiming) {
+        qDebug() << "GPU timer queries not supported, profiling CPU only";
+        release();
+    }
+}
+
+void FrameProfiler::release()
+{
+    for (StageData &stage : m_stages) {
+        for (int i = 0; i < QUERY_RING; ++i) {
+            delete stage.queries[i];
+            stage.queries[i] = nullptr;
+            stage.pending[i] = false;
+        }
+    }
+}
+
+void FrameProfiler::beginFrame()
+{
+    m_slot = (m_slot + 1) % QUERY_RING;
+    collect();
+    begin(Frame, false);
+}
+
+void FrameProfiler::endFrame()
+{
+    end(Frame);
+}
+
+void FrameProfiler::begin(Stage stage, bool gpu)
+{
+    StageData &data = m_stages[stage];
+    data.cpuBegin = m_clock.nsecsElapsed();
+
+    data.gpuActive = gpu && m_gpuTiming;
+    if (data.gpuActive)
+        data.queries[m_slot]->begin();
+}
+
+void FrameProfiler::end(Stage stage)
+{
+    StageData &data = m_stages[stage];
+    data.cpu.add((m_clock.nsecsElapsed() - data.cpuBegin) * 1e-6f);
+
+    if (data.gpuActive) {
+        data.queries[m_slot]->end();
+        data.pending[m_slot] = true;
+        data.gpuActive = false;
+    }
+}
+
+/**
+ * 读取已完成的GPU查询, 未完成且即将复用的查询直接丢弃
+ **/
+void FrameProfiler::collect()
+{
+    if (!m_gpuTiming)
+        return;
+
+    for (StageData &data : m_stages) {
+        for (int i = 0; i < QUERY_RING; ++i) {
+            if (!data.pending[i])
+                continue;
+            if (data.queries[i]->isResultAvailable()) {
+                data.lastGpu = data.queries[i]->waitForResult() * 1e-6f;
+                data.gpu.add(data.lastGpu);
+                data.pending[i] = false;
+            } else if (i == m_slot) {
+                data.pending[i] = false;
+            }
+        }
+    }
+}
+
+QVariantList FrameProfiler::snapshot() const
+{
+    QVariantList result;
+    for (int i = 0; i < StageCount; ++i) {
+        const StageData &data = m_stages[i];
+        if (data.cpu.values.isEmpty())
+            continue;
+
+        QVariantMap stage;
+        float min, avg, p99;
+        stage["name"] = stageName(Stage(i));
+        data.cpu.stats(min, avg, p99);
+        stage["cpuMin"] = min;
+        stage["cpuAvg"] = avg;
+        stage["cpuP99"] = p99;
+        data.gpu.stats(min, avg, p99);
+        stage["gpuMin"] = min;
+        stage["gpuAvg"] = avg;
+        stage["gpuP99"] = p99;
+        result.append(stage);
+    }
+    return result;
+}
+
+float FrameProfiler::lastGpuTime(Stage stage) const
+{
+    return m_stages[stage].lastGpu;
+}
+
+QString FrameProfiler::stageName(Stage stage)
+{
+    switch (stage) {
+    case Frame:      return "frame";
+    case PoseWait:   return "poseWait";
+    case LeftEye:    return "leftEye";
+    case RightEye:   return "rightEye";
+    case StereoEyes: return "stereoEyes";
+    case Resolve:    return "resolve";
+    case Submit:     return "submit";
+    case Mirror:     return "mirror";
+    default:         return "unknown";
+    }
+}
+
+/**
+ * 文本表格, 单位毫秒
+ **/
+QString FrameProfiler::format(const QVariantList &snapshot)
+{
+    QString text = QString("%1 %2 %3 %4 %5 %6 %7\n")
+            .arg("stage", -12).arg("cpu min", 9).arg("cpu avg", 9).arg("cpu p99", 9)
+            .arg("gpu min", 9).arg("gpu avg", 9).arg("gpu p99", 9);
+    for (const QVariant &entry : snapshot) {
+        const QVariantMap stage = entry.toMap();
+        text += QString("%1 %2 %3 %4 %5 %6 %7\n")
+                .arg(stage["name"].toString(), -12)
+                .arg(stage["cpuMin"].toFloat(), 9, 'f', 3)
+                .arg(stage["cpuAvg"].toFloat(), 9, 'f', 3)
+                .arg(stage["cpuP99"].toFloat(), 9, 'f', 3)
+                .arg(stage["gpuMin"].toFloat(), 9, 'f', 3)
+                .arg(stage["gpuAvg"].toFloat(), 9, 'f', 3)
+                .arg(stage["gpuP99"].toFloat(), 9, 'f', 3);
+    }
+    return text;
+}
+
+void FrameProfiler::Samples::add(float value)
+{
+    if (values.size() < HISTORY) {
+        values.append(value);
+    } else {
+        values[next] = value;
+        next = (next + 1) % HISTORY;
+    }
+}
+
+void FrameProfiler::Samples::stats(float &min, float &avg, float &p99) const
+{
+    min = avg = p99 = 0.0f;
+    if (values.isEmpty())
+        return;
+
+    QVector<float> sorted = values;
+    std::sort(sorted.begin(), sorted.end());
+    min = sorted.first();
+    p99 = sorted[qMin(sorted.size() - 1, int(sorted.size() * 0.99f))];
+    float sum = 0.0f;
+    for (float value : sorted)
+        sum += value;
+    avg = sum / sorted.size();
+}
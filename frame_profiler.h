@@ -0,0 +1,84 @@
+﻿#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <QElapsedTimer>
+#include <QOpenGLTimerQuery>
+#include <QString>
+#include <QVariantList>
+#include <QVector>
+
+/**
+ * 帧耗时统计
+ * Records CPU timestamps around each stage of VRRender::renderImage() and a
+ * GL_TIME_ELAPSED query around each GPU pass. Queries live in a small ring
+ * per stage and are only read once available, so profiling never stalls
+ * the pipeline. GPU stages must not nest, CPU-only stages may.
+ **/
+class FrameProfiler
+{
+public:
+    enum Stage {
+        Frame,
+        PoseWait,
+        LeftEye,
+        RightEye,
+        StereoEyes,
+        Resolve,
+        Submit,
+        Mirror,
+        StageCount
+    };
+
+    FrameProfiler();
+    ~FrameProfiler();
+
+    void init();
+    void release();
+
+    void beginFrame();
+    void endFrame();
+
+    void begin(Stage stage, bool gpu = true);
+    void end(Stage stage);
+
+    // rolling min/avg/p99 in milliseconds, one QVariantMap per stage that ran
+    QVariantList snapshot() const;
+
+    // latest GPU time of a stage in milliseconds, 0 when unknown
+    float lastGpuTime(Stage stage) const;
+
+    static QString stageName(Stage stage);
+    static QString format(const QVariantList &snapshot);
+
+private:
+    enum { QUERY_RING = 4, HISTORY = 240 };
+
+    struct Samples
+    {
+        QVector<float> values;
+        int next = 0;
+
+        void add(float value);
+        void stats(float &min, float &avg, float &p99) const;
+    };
+
+    struct StageData
+    {
+        QOpenGLTimerQuery *queries[QUERY_RING] = {};
+        bool pending[QUERY_RING] = {};
+        bool gpuActive = false;
+        qint64 cpuBegin = 0;
+        float lastGpu = 0.0f;
+        Samples cpu;
+        Samples gpu;
+    };
+
+    void collect();
+
+    QElapsedTimer m_clock;
+    StageData m_stages[StageCount];
+    int m_slot;
+    bool m_gpuTiming;
+};
+
+#endif // FRAMEPROFILER_H
@@ -1,4 +1,49 @@
-﻿#include "image_view.h"
+﻿#include <QQuickWindow>
+#include <QSGGeometryNode>
+#include <QSGTextureMaterial>
+#include "image_view.h"
+
+namespace {
+
+/**
+ * 带多级纹理的帧节点, 拥有其纹理
+ **/
+class MipmapNode : public QSGGeometryNode
+{
+public:
+    MipmapNode()
+        : m_geometry(QSGGeometry::defaultAttributes_TexturedPoint2D(), 4)
+    {
+        m_material.setFiltering(QSGTexture::Linear);
+        m_material.setMipmapFiltering(QSGTexture::Linear);
+        setGeometry(&m_geometry);
+        setMaterial(&m_material);
+    }
+
+    ~MipmapNode() override
+    {
+        delete m_material.texture();
+    }
+
+    void setTexture(QSGTexture *texture)
+    {
+        delete m_material.texture();
+        m_material.setTexture(texture);
+        markDirty(DirtyMaterial);
+    }
+
+    void setRect(const QRectF &rect)
+    {
+        QSGGeometry::updateTexturedRectGeometry(&m_geometry, rect, m_material.texture()->normalizedTextureSubRect());
+        markDirty(DirtyGeometry);
+    }
+
+private:
+    QSGGeometry m_geometry;
+    QSGTextureMaterial m_material;
+};
+
+}
 
 ImageView::ImageView(QQuickItem *parent)
     : QQuickPaintedItem(parent)
@@ -9,35 +54,91 @@ ImageView::ImageView(QQuickItem *parent)
     m_aspectRatioMode = Qt::IgnoreAspectRatio;
 }
 
+/**
+ * 绑定了帧序号时只在序号变化时重绘
+ **/
 void ImageView::updateImage(const QImage &image)
 {
+    const bool resized = m_image.size() != image.size();
     m_image = image;
-    update();             // triggers actual update
+    m_textureDirty = true;
+    if(resized)
+        updateContentRect();
+    if(m_frameSequence < 0)
+        update();             // triggers actual update
 }
 
 void ImageView::paint(QPainter *painter)
 {
+    // the mipmapped node draws the frame and requests the next one
+    if(m_filtering == Mipmap)
+        return;
+    // paint() runs on the scene graph render thread, the request is delivered on the GUI thread
     if(m_image.isNull()){
-        requestRender();
-        update();
+        QMetaObject::invokeMethod(this, "requestRender", Qt::QueuedConnection);
         return;
     }
-    if(m_aspectRatioMode != Qt::IgnoreAspectRatio)
-    {
-        m_image = m_image.scaled(this->boundingRect().width(),this->boundingRect().height(),
-                                 (Qt::AspectRatioMode)m_aspectRatioMode,Qt::FastTransformation);
-        int x = (this->boundingRect().width() - m_image.width()) / 2;
-        int y = (this->boundingRect().height() - m_image.height()) / 2;
-        setContentRect(QRect(x,y,m_image.width(),m_image.height()));
-        painter->drawImage(QRect(x ,y,m_image.width(),m_image.height()), m_image);
+    // the FBO paint engine scales while sampling the uploaded texture, the image itself is never resized
+    painter->setRenderHint(QPainter::SmoothPixmapTransform, m_filtering != Nearest);
+    painter->drawImage(m_contentRect, m_image);
+    QMetaObject::invokeMethod(this, "requestRender", Qt::QueuedConnection);
+}
+
+/**
+ * 按宽高比模式计算内容区域, 只在尺寸或模式变化时调用
+ **/
+void ImageView::updateContentRect()
+{
+    const QRect bounds = boundingRect().toRect();
+    if(m_aspectRatioMode == Qt::IgnoreAspectRatio || m_image.isNull()){
+        setContentRect(bounds);
+        return;
     }
-    else
-    {
-        setContentRect(this->boundingRect().toRect());
-        painter->drawImage(this->boundingRect(), m_image);
+
+    QSize size = m_image.size().scaled(bounds.size(), (Qt::AspectRatioMode)m_aspectRatioMode);
+    int x = (bounds.width() - size.width()) / 2;
+    int y = (bounds.height() - size.height()) / 2;
+    setContentRect(QRect(QPoint(x, y), size));
+}
+
+/**
+ * Mipmap时在QPainter的节点下挂一个多级纹理节点绘制帧, 其余情况由paint()绘制
+ **/
+QSGNode *ImageView::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data)
+{
+    QSGNode *node = QQuickPaintedItem::updatePaintNode(oldNode, data);
+    if(!node)
+        return node;
+
+    MipmapNode *mipmapNode = static_cast<MipmapNode*>(node->firstChild());
+    if(m_filtering != Mipmap || m_image.isNull()){
+        delete mipmapNode;
+        if(m_filtering == Mipmap)
+            QMetaObject::invokeMethod(this, "requestRender", Qt::QueuedConnection);
+        return node;
     }
-    requestRender();
-    update();
+
+    if(!mipmapNode){
+        mipmapNode = new MipmapNode;
+        node->appendChildNode(mipmapNode);
+        m_textureDirty = true;
+    }
+    // the painter samples a plain texture, only a scene graph texture can minify through mip levels
+    if(m_textureDirty){
+        mipmapNode->setTexture(window()->createTextureFromImage(m_image, QQuickWindow::TextureHasMipmaps));
+        m_textureDirty = false;
+    }
+    mipmapNode->setRect(m_contentRect);
+    // paint() draws nothing in this mode, the frame request is made here
+    QMetaObject::invokeMethod(this, "requestRender", Qt::QueuedConnection);
+    return node;
+}
+
+void ImageView::geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry)
+{
+    QQuickPaintedItem::geometryChanged(newGeometry, oldGeometry);
+    if(newGeometry.size() != oldGeometry.size())
+        updateContentRect();
 }
 
 QImage ImageView::image() const
@@ -55,6 +156,42 @@ QRect ImageView::contentRect() const
     return m_contentRect;
 }
 
+int ImageView::frameSequence() const
+{
+    return m_frameSequence;
+}
+
+void ImageView::setFrameSequence(int frameSequence)
+{
+    if (m_frameSequence == frameSequence)
+        return;
+
+    m_frameSequence = frameSequence;
+    m_textureDirty = true;
+    emit frameSequenceChanged(m_frameSequence);
+    update();
+}
+
+ImageView::Filtering ImageView::filtering() const
+{
+    return m_filtering;
+}
+
+/**
+ * Linear绘制到contentRect时双线性采样, 同时平滑本项在场景中的纹理;
+ * Mipmap把帧上传为多级纹理直接由场景图绘制, 缩小很多时不再走样
+ **/
+void ImageView::setFiltering(Filtering filtering)
+{
+    if (m_filtering == filtering)
+        return;
+
+    m_filtering = filtering;
+    setSmooth(m_filtering != Nearest);
+    emit filteringChanged(m_filtering);
+    update();
+}
+
 void ImageView::setAspectRatioMode(int aspectRatioMode)
 {
     if (m_aspectRatioMode == aspectRatioMode)
@@ -62,6 +199,8 @@ void ImageView::setAspectRatioMode(int aspectRatioMode)
 
     m_aspectRatioMode = aspectRatioMode;
     emit aspectRatioModeChanged(m_aspectRatioMode);
+    updateContentRect();
+    update();
 }
 
 void ImageView::setContentRect(QRect contentRect)
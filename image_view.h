@@ -12,8 +12,19 @@ class ImageView : public QQuickPaintedItem
     Q_PROPERTY(QImage image WRITE updateImage READ image)
     Q_PROPERTY(int aspectRatioMode READ aspectRatioMode WRITE setAspectRatioMode NOTIFY aspectRatioModeChanged)
     Q_PROPERTY(QRect contentRect READ contentRect WRITE setContentRect NOTIFY contentRectChanged)
+    Q_PROPERTY(int frameSequence READ frameSequence WRITE setFrameSequence NOTIFY frameSequenceChanged)
+    Q_PROPERTY(Filtering filtering READ filtering WRITE setFiltering NOTIFY filteringChanged)
 
 public:
+    // how the frame is sampled when it is drawn into contentRect; Mipmap draws it through
+    // a mipmapped scene graph texture instead of the painter, for views much smaller than the frame
+    enum Filtering {
+        Nearest,
+        Linear,
+        Mipmap
+    };
+    Q_ENUM(Filtering)
+
     ImageView(QQuickItem* parent = nullptr);
     void paint(QPainter *painter) override;
 
@@ -22,6 +33,10 @@ public:
 
     QRect contentRect() const;
 
+    int frameSequence() const;
+
+    Filtering filtering() const;
+
 public slots:
     void updateImage(const QImage& image);
 
@@ -29,17 +44,33 @@ public slots:
 
     void setContentRect(QRect contentRect);
 
+    void setFrameSequence(int frameSequence);
+
+    void setFiltering(Filtering filtering);
+
     bool contentRectContains(int x,int y);
 
 signals:
     void aspectRatioModeChanged(int aspectRatioMode);
     void contentRectChanged(QRect contentRect);
+    void frameSequenceChanged(int frameSequence);
+    void filteringChanged(Filtering filtering);
+    // a frame was shown, the view is ready for the next one
     void requestRender();
 
 protected:
+    void geometryChanged(const QRectF &newGeometry, const QRectF &oldGeometry) override;
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *data) override;
+    void updateContentRect();
+
     QImage m_image;
     int m_aspectRatioMode = Qt::IgnoreAspectRatio;
     QRect m_contentRect;
+    // -1 until bound: every image change repaints
+    int m_frameSequence = -1;
+    Filtering m_filtering = Linear;
+    // set on the GUI thread when the frame changes, consumed by the mipmapped node
+    bool m_textureDirty = true;
 };
 
 #endif // IMAGEVIEW_H
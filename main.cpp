@@ -1,13 +1,51 @@
 ﻿#include <QGuiApplication>
 #include <QQmlApplicationEngine>
+#include <QCommandLineParser>
+#include <QTimer>
+#include <QDebug>
 #include "image_view.h"
+#include "mirror_view.h"
 #include "vr_render.h"
 
 int main(int argc, char *argv[])
 {
     QCoreApplication::setAttribute(Qt::AA_EnableHighDpiScaling);
+    // VRRender shares its textures with Qt Quick for the zero-copy mirror
+    QCoreApplication::setAttribute(Qt::AA_ShareOpenGLContexts);
     QGuiApplication app(argc, argv);
+
+    QCommandLineParser parser;
+    parser.addHelpOption();
+    QCommandLineOption backendOption("backend", "VR runtime: openvr or mock.", "name");
+    QCommandLineOption atlasOption("sprite-atlas", "Prebuilt sprite atlas, written from the PNGs when missing.", "file");
+    QCommandLineOption headlessOption("headless", "Run the frame loop without a window for <ms>, then print statistics.", "ms");
+    parser.addOption(backendOption);
+    parser.addOption(atlasOption);
+    parser.addOption(headlessOption);
+    parser.process(app);
+
+    if (parser.isSet(backendOption))
+        VRRender::setBackendName(parser.value(backendOption));
+    if (parser.isSet(atlasOption))
+        VRRender::setSpriteAtlasPath(parser.value(atlasOption));
+
+    // benchmark mode, e.g. QT_QPA_PLATFORM=offscreen LIBGL_ALWAYS_SOFTWARE=1 ./OpenGL_Demo --backend mock --headless 10000
+    if (parser.isSet(headlessOption)) {
+        VRRender render;
+        render.setRunning(true);
+        QTimer::singleShot(parser.value(headlessOption).toInt(), &app, [&]() {
+            render.setRunning(false);
+            qInfo() << render.startupStatistics();
+            qInfo() << render.backendStatistics();
+            qInfo() << render.compositorStats();
+            render.dumpProfile();
+            app.quit();
+        });
+        return app.exec();
+    }
+
     qmlRegisterType<ImageView>("OpenGLDemo",1,0,"ImageView");
+    qmlRegisterType<MirrorView>("OpenGLDemo",1,0,"MirrorView");
     qmlRegisterType<VRRender>("OpenGLDemo",1,0,"VRRender");
 
     QQmlApplicationEngine engine;
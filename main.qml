@@ -10,18 +10,32 @@ Window {
 
     VRRender{
         id: render
+        running: true
+        // readback and shared texture are downscaled to what the view can show
+        mirrorSize: Qt.size(mirrorLoader.width * Screen.devicePixelRatio,
+                            mirrorLoader.height * Screen.devicePixelRatio)
     }
 
-    ImageView{
-        id:imageView
+    // zero-copy texture path when contexts are shared, CPU readback otherwise
+    Loader{
+        id: mirrorLoader
         anchors.fill: parent
-        image: render.frame
+        sourceComponent: render.sharedTexture ? mirrorViewComponent : imageViewComponent
     }
 
-    Timer {
-        interval: 10;
-        running: true;
-        repeat: true
-        onTriggered: render.renderImage()
+    Component{
+        id: mirrorViewComponent
+        MirrorView{
+            renderer: render
+        }
+    }
+
+    Component{
+        id: imageViewComponent
+        ImageView{
+            image: render.frame
+            frameSequence: render.frameSequence
+            onRequestRender: render.requestFrame()
+        }
     }
 }
@@ -0,0 +1,179 @@
+﻿#include <cstring>
+#include <QDebug>
+#include "mirror_readback.h"
+
+MirrorReadback::MirrorReadback()
+    : m_gl(nullptr)
+    ,m_ringSize(3)
+    ,m_readbackDepth(1)
+    ,m_head(0)
+    ,m_pending(0)
+    ,m_ringDirty(true)
+{
+}
+
+MirrorReadback::~MirrorReadback()
+{
+    // GL objects must be released by the owner while its context is current
+    for(Slot *slot : m_slots)
+        delete slot;
+}
+
+void MirrorReadback::init(QOpenGLExtraFunctions *gl)
+{
+    m_gl = gl;
+    m_ringDirty = true;
+}
+
+void MirrorReadback::release()
+{
+    destroyRing();
+    m_gl = nullptr;
+}
+
+/**
+ * 将source中rect区域的像素异步读入下一个PBO
+ **/
+void MirrorReadback::queue(QOpenGLFramebufferObject *source, const QRect &rect)
+{
+    if(!m_gl || !source || rect.isEmpty())
+        return;
+
+    if(m_ringDirty)
+        createRing();
+
+    // ring is full: the oldest frame is dropped rather than waited for
+    if(m_pending == m_slots.size())
+        dropOldest();
+
+    Slot *slot = m_slots[m_head];
+    const int bytes = rect.width() * rect.height() * 4;
+    slot->buffer.bind();
+    if(slot->size != rect.size()){
+        slot->buffer.allocate(bytes);
+        slot->size = rect.size();
+    }
+
+    source->bind();
+    m_gl->glPixelStorei(GL_PACK_ALIGNMENT, 4);
+    m_gl->glReadPixels(rect.x(), rect.y(), rect.width(), rect.height(),
+                       GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    source->release();
+    slot->buffer.release();
+
+    slot->fence = m_gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    m_head = (m_head + 1) % m_slots.size();
+    m_pending += 1;
+}
+
+/**
+ * 取出最早完成的回读帧, 未就绪时立即返回false
+ **/
+bool MirrorReadback::take(QImage &image, bool drain)
+{
+    if(!m_gl || m_pending == 0 || (!drain && m_pending <= m_readbackDepth))
+        return false;
+
+    const int tail = (m_head - m_pending + m_slots.size()) % m_slots.size();
+    Slot *slot = m_slots[tail];
+
+    GLenum status = m_gl->glClientWaitSync(slot->fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+    if(status == GL_TIMEOUT_EXPIRED)
+        return false;
+    if(status == GL_WAIT_FAILED){
+        qDebug() << "MirrorReadback fence wait failed";
+        dropOldest();
+        return false;
+    }
+
+    m_gl->glDeleteSync(slot->fence);
+    slot->fence = nullptr;
+    m_pending -= 1;
+
+    const int width = slot->size.width();
+    const int height = slot->size.height();
+    const int stride = width * 4;
+
+    slot->buffer.bind();
+    const uchar *pixels = static_cast<const uchar*>(
+                slot->buffer.mapRange(0, stride * height, QOpenGLBuffer::RangeRead));
+    if(!pixels){
+        slot->buffer.release();
+        return false;
+    }
+
+    // reuse the caller's image unless it is still shared with a consumer
+    if(image.size() != slot->size || image.format() != QImage::Format_RGBA8888 || !image.isDetached())
+        image = QImage(width, height, QImage::Format_RGBA8888);
+
+    // OpenGL rows are bottom-up
+    for(int y = 0; y < height; ++y)
+        memcpy(image.scanLine(height - 1 - y), pixels + y * stride, stride);
+
+    slot->buffer.unmap();
+    slot->buffer.release();
+    return true;
+}
+
+int MirrorReadback::ringSize() const
+{
+    return m_ringSize;
+}
+
+void MirrorReadback::setRingSize(int ringSize)
+{
+    ringSize = qBound(int(MinRingSize), ringSize, int(MaxRingSize));
+    if(m_ringSize == ringSize)
+        return;
+
+    m_ringSize = ringSize;
+    m_readbackDepth = qMin(m_readbackDepth, m_ringSize - 1);
+    m_ringDirty = true;
+}
+
+int MirrorReadback::readbackDepth() const
+{
+    return m_readbackDepth;
+}
+
+void MirrorReadback::setReadbackDepth(int readbackDepth)
+{
+    m_readbackDepth = qBound(0, readbackDepth, m_ringSize - 1);
+}
+
+void MirrorReadback::createRing()
+{
+    destroyRing();
+    for(int i = 0; i < m_ringSize; ++i){
+        Slot *slot = new Slot;
+        slot->buffer.setUsagePattern(QOpenGLBuffer::StreamRead);
+        slot->buffer.create();
+        m_slots.append(slot);
+    }
+    m_ringDirty = false;
+}
+
+void MirrorReadback::destroyRing()
+{
+    for(Slot *slot : m_slots){
+        if(slot->fence && m_gl)
+            m_gl->glDeleteSync(slot->fence);
+        slot->buffer.destroy();
+        delete slot;
+    }
+    m_slots.clear();
+    m_head = 0;
+    m_pending = 0;
+}
+
+void MirrorReadback::dropOldest()
+{
+    const int tail = (m_head - m_pending + m_slots.size()) % m_slots.size();
+    Slot *slot = m_slots[tail];
+    if(slot->fence){
+        m_gl->glDeleteSync(slot->fence);
+        slot->fence = nullptr;
+    }
+    m_pending -= 1;
+}
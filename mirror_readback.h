@@ -0,0 +1,61 @@
+﻿#ifndef MIRRORREADBACK_H
+#define MIRRORREADBACK_H
+
+#include <QImage>
+#include <QRect>
+#include <QVector>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLFramebufferObject>
+
+/**
+ * 镜像帧异步回读
+ * Reads the mirror frame back through a ring of pixel-buffer objects. Each
+ * queue() issues glReadPixels into the next PBO and drops a fence behind it;
+ * take() maps the oldest PBO only once it is readbackDepth frames old and its
+ * fence has signalled, so the render thread never stalls on the GPU. A
+ * draining take() skips the depth wait, for when nothing is queued behind.
+ **/
+class MirrorReadback
+{
+public:
+    // a slot must stay in flight while the next one is queued, so one slot never delivers
+    enum { MinRingSize = 2, MaxRingSize = 8 };
+
+    MirrorReadback();
+    ~MirrorReadback();
+
+    void init(QOpenGLExtraFunctions *gl);
+    void release();
+
+    void queue(QOpenGLFramebufferObject *source, const QRect &rect);
+    bool take(QImage &image, bool drain = false);
+
+    int ringSize() const;
+    void setRingSize(int ringSize);
+
+    int readbackDepth() const;
+    void setReadbackDepth(int readbackDepth);
+
+private:
+    struct Slot
+    {
+        QOpenGLBuffer buffer{QOpenGLBuffer::PixelPackBuffer};
+        GLsync fence = nullptr;
+        QSize size;
+    };
+
+    void createRing();
+    void destroyRing();
+    void dropOldest();
+
+    QOpenGLExtraFunctions *m_gl;
+    QVector<Slot*> m_slots;
+    int m_ringSize;
+    int m_readbackDepth;
+    int m_head;
+    int m_pending;
+    bool m_ringDirty;
+};
+
+#endif // MIRRORREADBACK_H
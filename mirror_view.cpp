@@ -0,0 +1,90 @@
+﻿#include <QQuickWindow>
+#include <QSGSimpleTextureNode>
+#include "mirror_view.h"
+
+MirrorView::MirrorView(QQuickItem *parent)
+    : QQuickItem(parent)
+{
+    setFlag(ItemHasContents, true);
+    connect(this, &QQuickItem::windowChanged, this, &MirrorView::handleWindowChanged);
+}
+
+MirrorView::~MirrorView()
+{
+    // detach without emitting rendererChanged from the destructor
+    if (m_renderer)
+        m_renderer->detachSharedFrameConsumer();
+}
+
+VRRender *MirrorView::renderer() const
+{
+    return m_renderer;
+}
+
+void MirrorView::setRenderer(VRRender *renderer)
+{
+    if (m_renderer == renderer)
+        return;
+
+    if (m_renderer) {
+        disconnect(m_renderer, &VRRender::sharedFrameChanged, this, &QQuickItem::update);
+        m_renderer->detachSharedFrameConsumer();
+    }
+
+    m_renderer = renderer;
+
+    if (m_renderer) {
+        m_renderer->attachSharedFrameConsumer();
+        connect(m_renderer, &VRRender::sharedFrameChanged, this, &QQuickItem::update);
+    }
+    emit rendererChanged(m_renderer);
+    update();
+}
+
+QSGNode *MirrorView::updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *)
+{
+    QSGSimpleTextureNode *node = static_cast<QSGSimpleTextureNode*>(oldNode);
+
+    GLuint textureId = 0;
+    QSize size;
+    m_sampledRenderer = m_renderer;
+    if (!m_renderer || !m_renderer->acquireSharedFrame(textureId, size))
+        return node;
+
+    if (!node) {
+        node = new QSGSimpleTextureNode;
+        node->setOwnsTexture(true);
+        node->setFiltering(QSGTexture::Linear);
+        // OpenGL textures are bottom-up
+        node->setTextureCoordinatesTransform(QSGSimpleTextureNode::MirrorVertically);
+    }
+
+    // the texture wrapper only changes when the triple buffer hands out another slot
+    QSGTexture *texture = node->texture();
+    if (!texture || GLuint(texture->textureId()) != textureId || texture->textureSize() != size)
+        node->setTexture(window()->createTextureFromId(textureId, size));
+
+    node->setRect(boundingRect());
+    node->markDirty(QSGNode::DirtyMaterial);
+    return node;
+}
+
+void MirrorView::handleWindowChanged(QQuickWindow *window)
+{
+    // the old window's render thread must not fence a frame it no longer samples
+    disconnect(m_afterRendering);
+    m_afterRendering = QMetaObject::Connection();
+    // direct: runs on the render thread with the scene graph context current
+    if (window)
+        m_afterRendering = connect(window, &QQuickWindow::afterRendering, this, &MirrorView::fenceSampledFrame,
+                                   Qt::DirectConnection);
+}
+
+/**
+ * 场景图绘制完成后通知VRRender, 该共享纹理在这之后才可被覆盖
+ **/
+void MirrorView::fenceSampledFrame()
+{
+    if (m_sampledRenderer)
+        m_sampledRenderer->fenceSharedFrame();
+}
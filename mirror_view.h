@@ -0,0 +1,47 @@
+﻿#ifndef MIRRORVIEW_H
+#define MIRRORVIEW_H
+
+#include <QPointer>
+#include <QQuickItem>
+#include "vr_render.h"
+
+/**
+ * 零拷贝镜像显示
+ * Scene graph item that samples VRRender's shared mirror texture directly,
+ * with no CPU readback, QImage or texture upload in between. Requires
+ * Qt::AA_ShareOpenGLContexts; ImageView remains the fallback otherwise.
+ **/
+class MirrorView : public QQuickItem
+{
+    Q_OBJECT
+    Q_DISABLE_COPY(MirrorView)
+    Q_PROPERTY(VRRender* renderer READ renderer WRITE setRenderer NOTIFY rendererChanged)
+
+public:
+    MirrorView(QQuickItem* parent = nullptr);
+    ~MirrorView();
+
+    VRRender* renderer() const;
+
+public slots:
+    void setRenderer(VRRender* renderer);
+
+signals:
+    void rendererChanged(VRRender* renderer);
+
+protected:
+    QSGNode *updatePaintNode(QSGNode *oldNode, UpdatePaintNodeData *) override;
+
+private slots:
+    void handleWindowChanged(QQuickWindow *window);
+    void fenceSampledFrame();
+
+private:
+    QPointer<VRRender> m_renderer;
+    // renderer whose texture the scene graph samples, only touched on the render thread
+    QPointer<VRRender> m_sampledRenderer;
+    // afterRendering of the window the item is in; dropped when the item moves to another window
+    QMetaObject::Connection m_afterRendering;
+};
+
+#endif // MIRRORVIEW_H
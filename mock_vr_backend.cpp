@@ -0,0 +1,452 @@
+﻿#include <QCoreApplication>
+#include <QDebug>
+#include <QMatrix4x4>
+#include <QOpenGLContext>
+#include <QOpenGLFunctions>
+#include <QPainter>
+#include <QThread>
+#include <QtMath>
+#include "mock_vr_backend.h"
+
+const int MOCK_DEFAULT_REFRESH_RATE = 90;
+const int HIDDEN_AREA_SEGMENTS = 8;
+const int FRAME_TIMING_HISTORY = 128;
+
+MockVRBackend::MockVRBackend(int refreshRate)
+    : m_refreshRate(refreshRate > 0 ? refreshRate : MOCK_DEFAULT_REFRESH_RATE)
+    ,m_eyeWidth(1080)
+    ,m_eyeHeight(1200)
+    ,m_ipd(0.064f)
+    ,m_vsyncToPhotons(0.011f)
+    ,m_lastVsync(-1)
+    ,m_submitted{false, false}
+    ,m_cumulative()
+    ,m_lastWait(-1)
+    ,m_frames(0)
+    ,m_submits(0)
+    ,m_missedVsyncs(0)
+    ,m_incompleteFrames(0)
+    ,m_doubleSubmits(0)
+    ,m_depthSubmits(0)
+    ,m_mirrorTextures{0, 0}
+    ,m_mirrorLocked{false, false}
+    ,m_mirrorLocks(0)
+    ,m_unbalancedLocks(0)
+{
+}
+
+bool MockVRBackend::init()
+{
+    buildHiddenAreaMesh();
+    m_clock.start();
+    m_lastVsync = -1;
+    m_lastWait = -1;
+    m_timings.clear();
+    m_cumulative = vr::Compositor_CumulativeStats();
+    m_cumulative.m_nPid = QCoreApplication::applicationPid();
+    qDebug() << "mock VR runtime:" << m_refreshRate << "Hz," << m_eyeWidth << "x" << m_eyeHeight << "per eye";
+    return true;
+}
+
+void MockVRBackend::shutdown()
+{
+    if (m_frames > 0)
+        qDebug() << "mock VR runtime:" << statistics();
+}
+
+QString MockVRBackend::name() const
+{
+    return "mock";
+}
+
+vr::HmdMatrix44_t MockVRBackend::projectionMatrix(vr::Hmd_Eye eye, float nearClip, float farClip)
+{
+    // slightly asymmetric frusta, wider towards the temple like a real lens
+    const float inner = 1.0f, outer = 1.2f, vertical = 1.1f;
+    const float left = eye == vr::Eye_Left ? -outer : -inner;
+    const float right = eye == vr::Eye_Left ? inner : outer;
+
+    QMatrix4x4 projection;
+    projection.frustum(left * nearClip, right * nearClip, -vertical * nearClip, vertical * nearClip, nearClip, farClip);
+
+    vr::HmdMatrix44_t mat;
+    for (int row = 0; row < 4; ++row)
+        for (int col = 0; col < 4; ++col)
+            mat.m[row][col] = projection(row, col);
+    return mat;
+}
+
+vr::HmdMatrix34_t MockVRBackend::eyeToHeadTransform(vr::Hmd_Eye eye)
+{
+    const float offset = (eye == vr::Eye_Left ? -0.5f : 0.5f) * m_ipd;
+    vr::HmdMatrix34_t mat = {{ {1.0f, 0.0f, 0.0f, offset},
+                               {0.0f, 1.0f, 0.0f, 0.0f},
+                               {0.0f, 0.0f, 1.0f, 0.0f} }};
+    return mat;
+}
+
+void MockVRBackend::recommendedRenderTargetSize(uint32_t *width, uint32_t *height)
+{
+    *width = m_eyeWidth;
+    *height = m_eyeHeight;
+}
+
+vr::HiddenAreaMesh_t MockVRBackend::hiddenAreaMesh(vr::Hmd_Eye)
+{
+    vr::HiddenAreaMesh_t mesh;
+    mesh.pVertexData = m_hiddenArea.isEmpty() ? nullptr : m_hiddenArea.constData();
+    mesh.unTriangleCount = m_hiddenArea.size() / 3;
+    return mesh;
+}
+
+QString MockVRBackend::trackedDeviceString(vr::TrackedDeviceIndex_t device, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *error)
+{
+    if (error)
+        *error = vr::TrackedProp_Success;
+    if (device != vr::k_unTrackedDeviceIndex_Hmd) {
+        if (error)
+            *error = vr::TrackedProp_InvalidDevice;
+        return "";
+    }
+
+    switch (prop) {
+    case vr::Prop_TrackingSystemName_String:
+        return "mock";
+    case vr::Prop_SerialNumber_String:
+        return "MOCK-HMD-0001";
+    default:
+        if (error)
+            *error = vr::TrackedProp_UnknownProperty;
+        return "";
+    }
+}
+
+float MockVRBackend::trackedDeviceFloat(vr::TrackedDeviceIndex_t device, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *error)
+{
+    if (error)
+        *error = vr::TrackedProp_Success;
+    if (device != vr::k_unTrackedDeviceIndex_Hmd) {
+        if (error)
+            *error = vr::TrackedProp_InvalidDevice;
+        return 0.0f;
+    }
+
+    switch (prop) {
+    case vr::Prop_DisplayFrequency_Float:
+        return m_refreshRate;
+    case vr::Prop_UserIpdMeters_Float:
+        return m_ipd;
+    case vr::Prop_SecondsFromVsyncToPhotons_Float:
+        return m_vsyncToPhotons;
+    default:
+        if (error)
+            *error = vr::TrackedProp_UnknownProperty;
+        return 0.0f;
+    }
+}
+
+/**
+ * 按刷新率等待下一个模拟垂直同步, 并给出该帧的预测头显位姿
+ **/
+vr::EVRCompositorError MockVRBackend::waitGetPoses(vr::TrackedDevicePose_t *poses, uint32_t count)
+{
+    const qint64 period = qint64(1e9 / m_refreshRate);
+
+    const bool complete = m_submitted[0] && m_submitted[1];
+    if (m_frames > 0 && !complete)
+        m_incompleteFrames += 1;
+
+    qint64 now = m_clock.nsecsElapsed();
+    qint64 vsync = m_lastVsync < 0 ? now : m_lastVsync + period;
+    qint64 missed = 0;
+    if (now > vsync + period) {
+        // the app was late, the compositor would have re-shown old frames
+        missed = (now - vsync) / period;
+        m_missedVsyncs += missed;
+        vsync += missed * period;
+    }
+    if (m_frames > 0)
+        recordFrameTiming(complete, missed, now);
+    if (vsync > now)
+        QThread::usleep((vsync - now) / 1000);
+
+    m_lastVsync = vsync;
+    m_lastWait = now;
+    m_frames += 1;
+    m_submitted[0] = m_submitted[1] = false;
+
+    for (uint32_t i = 0; i < count; ++i) {
+        poses[i] = vr::TrackedDevicePose_t();
+        poses[i].bPoseIsValid = false;
+        poses[i].bDeviceIsConnected = false;
+        poses[i].eTrackingResult = vr::TrackingResult_Uninitialized;
+    }
+    if (count > vr::k_unTrackedDeviceIndex_Hmd) {
+        // predicted for when the frame shown at the next vsync lights up
+        vr::TrackedDevicePose_t &hmd = poses[vr::k_unTrackedDeviceIndex_Hmd];
+        hmd.mDeviceToAbsoluteTracking = hmdPoseAt((vsync + period) * 1e-9 + m_vsyncToPhotons);
+        hmd.bPoseIsValid = true;
+        hmd.bDeviceIsConnected = true;
+        hmd.eTrackingResult = vr::TrackingResult_Running_OK;
+    }
+    return vr::VRCompositorError_None;
+}
+
+void MockVRBackend::deviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin, float secondsToPhotons, vr::TrackedDevicePose_t *poses, uint32_t count)
+{
+    for (uint32_t i = 0; i < count; ++i) {
+        poses[i] = vr::TrackedDevicePose_t();
+        poses[i].bPoseIsValid = false;
+        poses[i].bDeviceIsConnected = false;
+        poses[i].eTrackingResult = vr::TrackingResult_Uninitialized;
+    }
+    if (count > vr::k_unTrackedDeviceIndex_Hmd) {
+        vr::TrackedDevicePose_t &hmd = poses[vr::k_unTrackedDeviceIndex_Hmd];
+        hmd.mDeviceToAbsoluteTracking = hmdPoseAt(m_clock.nsecsElapsed() * 1e-9 + secondsToPhotons);
+        hmd.bPoseIsValid = true;
+        hmd.bDeviceIsConnected = true;
+        hmd.eTrackingResult = vr::TrackingResult_Running_OK;
+    }
+}
+
+bool MockVRBackend::timeSinceLastVsync(float *seconds, uint64_t *frameCounter)
+{
+    if (m_lastVsync < 0)
+        return false;
+    if (seconds)
+        *seconds = (m_clock.nsecsElapsed() - m_lastVsync) * 1e-9f;
+    // the same vsync counter the frame timings are indexed by
+    if (frameCounter)
+        *frameCounter = uint64_t(m_lastVsync / qint64(1e9 / m_refreshRate));
+    return true;
+}
+
+vr::EVRCompositorError MockVRBackend::submit(vr::Hmd_Eye eye, const vr::Texture_t *texture, const vr::VRTextureBounds_t *bounds, vr::EVRSubmitFlags flags)
+{
+    if (eye != vr::Eye_Left && eye != vr::Eye_Right)
+        return vr::VRCompositorError_IndexOutOfRange;
+    if (!texture || !texture->handle)
+        return vr::VRCompositorError_InvalidTexture;
+    if (bounds && (bounds->uMin == bounds->uMax || bounds->vMin == bounds->vMax))
+        return vr::VRCompositorError_InvalidBounds;
+    // depth is only accepted together with the pose, as VRTextureWithPoseAndDepth_t
+    const bool depth = flags & vr::Submit_TextureWithDepth;
+    if (depth && !(flags & vr::Submit_TextureWithPose))
+        return vr::VRCompositorError_InvalidTexture;
+    if (depth && !static_cast<const vr::VRTextureWithPoseAndDepth_t*>(texture)->depth.handle)
+        return vr::VRCompositorError_InvalidTexture;
+    if (m_submitted[eye]) {
+        m_doubleSubmits += 1;
+        return vr::VRCompositorError_AlreadySubmitted;
+    }
+
+    m_submitted[eye] = true;
+    m_submits += 1;
+    if (depth)
+        m_depthSubmits += 1;
+    return vr::VRCompositorError_None;
+}
+
+uint32_t MockVRBackend::frameTimings(vr::Compositor_FrameTiming *timings, uint32_t count)
+{
+    const int n = qMin(int(count), m_timings.size());
+    const int first = m_timings.size() - n;
+    for (int i = 0; i < n; ++i)
+        timings[i] = m_timings[first + i];
+    return n;
+}
+
+void MockVRBackend::cumulativeStats(vr::Compositor_CumulativeStats *stats)
+{
+    *stats = m_cumulative;
+}
+
+/**
+ * 合成器镜像纹理的替身: 在调用者当前上下文中创建一张静态的畸变后画面
+ **/
+vr::EVRCompositorError MockVRBackend::mirrorTextureGL(vr::Hmd_Eye eye, vr::glUInt_t *textureId, vr::glSharedTextureHandle_t *handle)
+{
+    if (eye != vr::Eye_Left && eye != vr::Eye_Right)
+        return vr::VRCompositorError_IndexOutOfRange;
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (!context)
+        return vr::VRCompositorError_SharedTexturesNotSupported;
+
+    if (!m_mirrorTextures[eye]) {
+        // OpenGL rows are bottom-up
+        const QImage image = mirrorImage(eye).convertToFormat(QImage::Format_RGBA8888).mirrored();
+        QOpenGLFunctions *gl = context->functions();
+        gl->glGenTextures(1, &m_mirrorTextures[eye]);
+        gl->glBindTexture(GL_TEXTURE_2D, m_mirrorTextures[eye]);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        gl->glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        gl->glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, image.width(), image.height(), 0,
+                         GL_RGBA, GL_UNSIGNED_BYTE, image.constBits());
+        gl->glBindTexture(GL_TEXTURE_2D, 0);
+    }
+
+    *textureId = m_mirrorTextures[eye];
+    // any stable non-null value identifies the eye
+    *handle = &m_mirrorTextures[eye];
+    return vr::VRCompositorError_None;
+}
+
+bool MockVRBackend::releaseMirrorTextureGL(vr::glUInt_t textureId, vr::glSharedTextureHandle_t handle)
+{
+    for (int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye) {
+        if (handle != &m_mirrorTextures[eye] || textureId != m_mirrorTextures[eye])
+            continue;
+        if (QOpenGLContext *context = QOpenGLContext::currentContext())
+            context->functions()->glDeleteTextures(1, &m_mirrorTextures[eye]);
+        m_mirrorTextures[eye] = 0;
+        m_mirrorLocked[eye] = false;
+        return true;
+    }
+    return false;
+}
+
+void MockVRBackend::lockSharedTexture(vr::glSharedTextureHandle_t handle)
+{
+    for (int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye) {
+        if (handle != &m_mirrorTextures[eye])
+            continue;
+        if (m_mirrorLocked[eye])
+            m_unbalancedLocks += 1;
+        m_mirrorLocked[eye] = true;
+        m_mirrorLocks += 1;
+    }
+}
+
+void MockVRBackend::unlockSharedTexture(vr::glSharedTextureHandle_t handle)
+{
+    for (int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye) {
+        if (handle != &m_mirrorTextures[eye])
+            continue;
+        if (!m_mirrorLocked[eye])
+            m_unbalancedLocks += 1;
+        m_mirrorLocked[eye] = false;
+    }
+}
+
+/**
+ * 结算上一帧: 迟到的帧被异步重投影, 未提交完整的帧被丢弃
+ **/
+void MockVRBackend::recordFrameTiming(bool complete, qint64 missedVsyncs, qint64 now)
+{
+    const qint64 period = qint64(1e9 / m_refreshRate);
+
+    vr::Compositor_FrameTiming timing = vr::Compositor_FrameTiming();
+    timing.m_nSize = sizeof(vr::Compositor_FrameTiming);
+    // the compositor frame the submission was due at: one vsync after the frame started
+    timing.m_nFrameIndex = uint32_t(m_lastVsync / period) + 1;
+    timing.m_nNumFramePresents = complete ? uint32_t(1 + missedVsyncs) : 0;
+    timing.m_nNumMisPresented = missedVsyncs > 0 ? 1 : 0;
+    timing.m_nNumDroppedFrames = complete ? 0 : uint32_t(1 + missedVsyncs);
+    if (complete && missedVsyncs > 0)
+        timing.m_nReprojectionFlags = vr::VRCompositor_ReprojectionAsync | vr::VRCompositor_ReprojectionReason_Cpu;
+    timing.m_flSystemTimeInSeconds = m_lastVsync * 1e-9;
+    timing.m_flClientFrameIntervalMs = m_lastWait < 0 ? 0.0f : (now - m_lastWait) * 1e-6f;
+
+    m_timings.append(timing);
+    if (m_timings.size() > FRAME_TIMING_HISTORY)
+        m_timings.removeFirst();
+
+    m_cumulative.m_nNumFramePresents += timing.m_nNumFramePresents;
+    m_cumulative.m_nNumDroppedFrames += timing.m_nNumDroppedFrames;
+    if (timing.m_nReprojectionFlags)
+        m_cumulative.m_nNumReprojectedFrames += uint32_t(missedVsyncs);
+}
+
+QVariantMap MockVRBackend::statistics() const
+{
+    const double seconds = m_clock.isValid() ? m_clock.nsecsElapsed() * 1e-9 : 0.0;
+
+    QVariantMap stats;
+    stats["refreshRate"] = m_refreshRate;
+    stats["seconds"] = seconds;
+    stats["frames"] = m_frames;
+    stats["framesPerSecond"] = seconds > 0.0 ? m_frames / seconds : 0.0;
+    stats["submits"] = m_submits;
+    stats["missedVsyncs"] = m_missedVsyncs;
+    stats["incompleteFrames"] = m_incompleteFrames;
+    stats["doubleSubmits"] = m_doubleSubmits;
+    stats["depthSubmits"] = m_depthSubmits;
+    stats["mirrorLocks"] = m_mirrorLocks;
+    stats["unbalancedMirrorLocks"] = m_unbalancedLocks;
+    return stats;
+}
+
+/**
+ * 四角被镜片遮挡: 每个角从角点向内切椭圆弧做三角扇
+ **/
+void MockVRBackend::buildHiddenAreaMesh()
+{
+    m_hiddenArea.clear();
+    const float corners[4][2] = { {1.0f, 1.0f}, {0.0f, 1.0f}, {0.0f, 0.0f}, {1.0f, 0.0f} };
+
+    for (int c = 0; c < 4; ++c) {
+        for (int s = 0; s < HIDDEN_AREA_SEGMENTS; ++s) {
+            const float a0 = (c + float(s) / HIDDEN_AREA_SEGMENTS) * float(M_PI_2);
+            const float a1 = (c + float(s + 1) / HIDDEN_AREA_SEGMENTS) * float(M_PI_2);
+            vr::HmdVector2_t corner = {{ corners[c][0], corners[c][1] }};
+            vr::HmdVector2_t p0 = {{ 0.5f + 0.5f * qCos(a0), 0.5f + 0.5f * qSin(a0) }};
+            vr::HmdVector2_t p1 = {{ 0.5f + 0.5f * qCos(a1), 0.5f + 0.5f * qSin(a1) }};
+            m_hiddenArea << corner << p0 << p1;
+        }
+    }
+}
+
+/**
+ * 模拟头部: 站立高度, 缓慢左右转头并轻微上下浮动
+ **/
+vr::HmdMatrix34_t MockVRBackend::hmdPoseAt(double seconds) const
+{
+    const float yaw = qDegreesToRadians(10.0f) * qSin(2.0 * M_PI * 0.2 * seconds);
+    const float height = 1.7f + 0.01f * qSin(2.0 * M_PI * 0.5 * seconds);
+    const float c = qCos(yaw), s = qSin(yaw);
+
+    vr::HmdMatrix34_t mat = {{ { c,    0.0f, s,    0.0f   },
+                               { 0.0f, 1.0f, 0.0f, height },
+                               { -s,   0.0f, c,    0.0f   } }};
+    return mat;
+}
+
+/**
+ * 模拟的畸变后画面: 黑底上的桶形镜片区域与网格, 标出眼睛
+ **/
+QImage MockVRBackend::mirrorImage(vr::Hmd_Eye eye) const
+{
+    QImage image(m_eyeWidth / 2, m_eyeHeight / 2, QImage::Format_RGB32);
+    image.fill(Qt::black);
+
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    const QRectF lens = QRectF(image.rect()).adjusted(image.width() * 0.05, image.height() * 0.05,
+                                                      -image.width() * 0.05, -image.height() * 0.05);
+    QRadialGradient vignette(lens.center(), qMax(lens.width(), lens.height()) * 0.5);
+    vignette.setColorAt(0.0, QColor(70, 70, 80));
+    vignette.setColorAt(1.0, QColor(20, 20, 25));
+    painter.setPen(Qt::NoPen);
+    painter.setBrush(vignette);
+    painter.drawEllipse(lens);
+
+    // grid lines bowed outwards like a pre-warped image
+    painter.setClipRegion(QRegion(lens.toRect(), QRegion::Ellipse));
+    painter.setPen(QPen(QColor(120, 160, 120), 1.5));
+    painter.setBrush(Qt::NoBrush);
+    for (int i = 1; i < 8; ++i) {
+        const qreal inset = lens.width() * 0.5 * (1.0 - i / 8.0);
+        painter.drawEllipse(lens.adjusted(inset, 0, -inset, 0));
+        const qreal insetY = lens.height() * 0.5 * (1.0 - i / 8.0);
+        painter.drawEllipse(lens.adjusted(0, insetY, 0, -insetY));
+    }
+    painter.setClipping(false);
+
+    painter.setPen(Qt::white);
+    QFont font = painter.font();
+    font.setPixelSize(image.height() / 12);
+    painter.setFont(font);
+    painter.drawText(image.rect(), Qt::AlignHCenter | Qt::AlignBottom,
+                     eye == vr::Eye_Left ? "mock mirror L" : "mock mirror R");
+    return image;
+}
@@ -0,0 +1,89 @@
+﻿#ifndef MOCKVRBACKEND_H
+#define MOCKVRBACKEND_H
+
+#include <QElapsedTimer>
+#include <QImage>
+#include <QVector>
+#include "vr_backend.h"
+
+/**
+ * 无头显的模拟运行时
+ * Paces waitGetPoses() to a synthetic vsync at a configurable refresh rate,
+ * streams a slowly swaying HMD pose and accounts every submit, so the frame
+ * loop can be benchmarked on a GPU-less box (e.g. Mesa llvmpipe with
+ * QT_QPA_PLATFORM=offscreen).
+ **/
+class MockVRBackend : public VRBackend
+{
+public:
+    explicit MockVRBackend(int refreshRate = 0);
+
+    bool init() override;
+    void shutdown() override;
+    QString name() const override;
+
+    vr::HmdMatrix44_t projectionMatrix(vr::Hmd_Eye eye, float nearClip, float farClip) override;
+    vr::HmdMatrix34_t eyeToHeadTransform(vr::Hmd_Eye eye) override;
+    void recommendedRenderTargetSize(uint32_t *width, uint32_t *height) override;
+    vr::HiddenAreaMesh_t hiddenAreaMesh(vr::Hmd_Eye eye) override;
+    QString trackedDeviceString(vr::TrackedDeviceIndex_t device,
+                                vr::TrackedDeviceProperty prop,
+                                vr::TrackedPropertyError *error = nullptr) override;
+    float trackedDeviceFloat(vr::TrackedDeviceIndex_t device,
+                             vr::TrackedDeviceProperty prop,
+                             vr::TrackedPropertyError *error = nullptr) override;
+    void deviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin origin, float secondsToPhotons,
+                                      vr::TrackedDevicePose_t *poses, uint32_t count) override;
+    bool timeSinceLastVsync(float *seconds, uint64_t *frameCounter) override;
+
+    vr::EVRCompositorError waitGetPoses(vr::TrackedDevicePose_t *poses, uint32_t count) override;
+    vr::EVRCompositorError submit(vr::Hmd_Eye eye, const vr::Texture_t *texture,
+                                  const vr::VRTextureBounds_t *bounds,
+                                  vr::EVRSubmitFlags flags = vr::Submit_Default) override;
+    uint32_t frameTimings(vr::Compositor_FrameTiming *timings, uint32_t count) override;
+    void cumulativeStats(vr::Compositor_CumulativeStats *stats) override;
+    vr::EVRCompositorError mirrorTextureGL(vr::Hmd_Eye eye, vr::glUInt_t *textureId,
+                                           vr::glSharedTextureHandle_t *handle) override;
+    bool releaseMirrorTextureGL(vr::glUInt_t textureId, vr::glSharedTextureHandle_t handle) override;
+    void lockSharedTexture(vr::glSharedTextureHandle_t handle) override;
+    void unlockSharedTexture(vr::glSharedTextureHandle_t handle) override;
+
+    QVariantMap statistics() const override;
+
+private:
+    void buildHiddenAreaMesh();
+    void recordFrameTiming(bool complete, qint64 missedVsyncs, qint64 now);
+    vr::HmdMatrix34_t hmdPoseAt(double seconds) const;
+    QImage mirrorImage(vr::Hmd_Eye eye) const;
+
+    float m_refreshRate;
+    uint32_t m_eyeWidth, m_eyeHeight;
+    float m_ipd;
+    float m_vsyncToPhotons;
+
+    QElapsedTimer m_clock;
+    qint64 m_lastVsync;
+    bool m_submitted[2];
+    QVector<vr::HmdVector2_t> m_hiddenArea;
+
+    // compositor view of the frames, finalized at the following waitGetPoses()
+    QVector<vr::Compositor_FrameTiming> m_timings;
+    vr::Compositor_CumulativeStats m_cumulative;
+    qint64 m_lastWait;
+
+    // submit accounting
+    quint64 m_frames;
+    quint64 m_submits;
+    quint64 m_missedVsyncs;
+    quint64 m_incompleteFrames;
+    quint64 m_doubleSubmits;
+    quint64 m_depthSubmits;
+
+    // synthetic post-distortion mirror, one texture per eye in the caller's context
+    vr::glUInt_t m_mirrorTextures[2];
+    bool m_mirrorLocked[2];
+    quint64 m_mirrorLocks;
+    quint64 m_unbalancedLocks;
+};
+
+#endif // MOCKVRBACKEND_H
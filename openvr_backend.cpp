@@ -0,0 +1,145 @@
+﻿#include <QDebug>
+#include "openvr_backend.h"
+
+OpenVRBackend::OpenVRBackend()
+    : m_hmd(nullptr)
+    ,m_compositor(nullptr)
+{
+}
+
+OpenVRBackend::~OpenVRBackend()
+{
+    shutdown();
+}
+
+bool OpenVRBackend::init()
+{
+    vr::EVRInitError error = vr::VRInitError_None;
+    m_hmd = vr::VR_Init(&error, vr::VRApplication_Scene);
+
+    if (error != vr::VRInitError_None)
+    {
+        m_hmd = nullptr;
+        QString message = vr::VR_GetVRInitErrorAsEnglishDescription(error);
+        qCritical() << message;
+        return false;
+    }
+
+    // turn on compositor
+    m_compositor = vr::VRCompositor();
+    if (!m_compositor)
+    {
+        QString message = "Compositor initialization failed. See log file for details";
+        qCritical() << message;
+        shutdown();
+        return false;
+    }
+    return true;
+}
+
+void OpenVRBackend::shutdown()
+{
+    if(m_hmd){
+        vr::VR_Shutdown();
+        m_hmd = nullptr;
+        m_compositor = nullptr;
+    }
+}
+
+QString OpenVRBackend::name() const
+{
+    return "openvr";
+}
+
+vr::HmdMatrix44_t OpenVRBackend::projectionMatrix(vr::Hmd_Eye eye, float nearClip, float farClip)
+{
+    return m_hmd->GetProjectionMatrix(eye, nearClip, farClip);
+}
+
+vr::HmdMatrix34_t OpenVRBackend::eyeToHeadTransform(vr::Hmd_Eye eye)
+{
+    return m_hmd->GetEyeToHeadTransform(eye);
+}
+
+void OpenVRBackend::recommendedRenderTargetSize(uint32_t *width, uint32_t *height)
+{
+    m_hmd->GetRecommendedRenderTargetSize(width, height);
+}
+
+vr::HiddenAreaMesh_t OpenVRBackend::hiddenAreaMesh(vr::Hmd_Eye eye)
+{
+    return m_hmd->GetHiddenAreaMesh(eye, vr::k_eHiddenAreaMesh_Standard);
+}
+
+QString OpenVRBackend::trackedDeviceString(vr::TrackedDeviceIndex_t device, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *error)
+{
+    uint32_t len = m_hmd->GetStringTrackedDeviceProperty(device, prop, NULL, 0, error);
+    if(len == 0)
+        return "";
+
+    char *buf = new char[len];
+    m_hmd->GetStringTrackedDeviceProperty(device, prop, buf, len, error);
+
+    QString result = QString::fromLocal8Bit(buf);
+    delete [] buf;
+
+    return result;
+}
+
+float OpenVRBackend::trackedDeviceFloat(vr::TrackedDeviceIndex_t device, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *error)
+{
+    return m_hmd->GetFloatTrackedDeviceProperty(device, prop, error);
+}
+
+void OpenVRBackend::deviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin origin, float secondsToPhotons, vr::TrackedDevicePose_t *poses, uint32_t count)
+{
+    m_hmd->GetDeviceToAbsoluteTrackingPose(origin, secondsToPhotons, poses, count);
+}
+
+bool OpenVRBackend::timeSinceLastVsync(float *seconds, uint64_t *frameCounter)
+{
+    return m_hmd->GetTimeSinceLastVsync(seconds, frameCounter);
+}
+
+vr::EVRCompositorError OpenVRBackend::waitGetPoses(vr::TrackedDevicePose_t *poses, uint32_t count)
+{
+    return m_compositor->WaitGetPoses(poses, count, NULL, 0);
+}
+
+vr::EVRCompositorError OpenVRBackend::submit(vr::Hmd_Eye eye, const vr::Texture_t *texture, const vr::VRTextureBounds_t *bounds, vr::EVRSubmitFlags flags)
+{
+    return m_compositor->Submit(eye, texture, bounds, flags);
+}
+
+uint32_t OpenVRBackend::frameTimings(vr::Compositor_FrameTiming *timings, uint32_t count)
+{
+    if (count == 0)
+        return 0;
+    timings[0].m_nSize = sizeof(vr::Compositor_FrameTiming);
+    return m_compositor->GetFrameTimings(timings, count);
+}
+
+void OpenVRBackend::cumulativeStats(vr::Compositor_CumulativeStats *stats)
+{
+    m_compositor->GetCumulativeStats(stats, sizeof(vr::Compositor_CumulativeStats));
+}
+
+vr::EVRCompositorError OpenVRBackend::mirrorTextureGL(vr::Hmd_Eye eye, vr::glUInt_t *textureId, vr::glSharedTextureHandle_t *handle)
+{
+    return m_compositor->GetMirrorTextureGL(eye, textureId, handle);
+}
+
+bool OpenVRBackend::releaseMirrorTextureGL(vr::glUInt_t textureId, vr::glSharedTextureHandle_t handle)
+{
+    return m_compositor->ReleaseSharedGLTexture(textureId, handle);
+}
+
+void OpenVRBackend::lockSharedTexture(vr::glSharedTextureHandle_t handle)
+{
+    m_compositor->LockGLSharedTextureForAccess(handle);
+}
+
+void OpenVRBackend::unlockSharedTexture(vr::glSharedTextureHandle_t handle)
+{
+    m_compositor->UnlockGLSharedTextureForAccess(handle);
+}
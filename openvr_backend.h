@@ -0,0 +1,50 @@
+﻿#ifndef OPENVRBACKEND_H
+#define OPENVRBACKEND_H
+
+#include "vr_backend.h"
+
+/**
+ * 转发到SteamVR运行时
+ **/
+class OpenVRBackend : public VRBackend
+{
+public:
+    OpenVRBackend();
+    ~OpenVRBackend();
+
+    bool init() override;
+    void shutdown() override;
+    QString name() const override;
+
+    vr::HmdMatrix44_t projectionMatrix(vr::Hmd_Eye eye, float nearClip, float farClip) override;
+    vr::HmdMatrix34_t eyeToHeadTransform(vr::Hmd_Eye eye) override;
+    void recommendedRenderTargetSize(uint32_t *width, uint32_t *height) override;
+    vr::HiddenAreaMesh_t hiddenAreaMesh(vr::Hmd_Eye eye) override;
+    QString trackedDeviceString(vr::TrackedDeviceIndex_t device,
+                                vr::TrackedDeviceProperty prop,
+                                vr::TrackedPropertyError *error = nullptr) override;
+    float trackedDeviceFloat(vr::TrackedDeviceIndex_t device,
+                             vr::TrackedDeviceProperty prop,
+                             vr::TrackedPropertyError *error = nullptr) override;
+    void deviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin origin, float secondsToPhotons,
+                                      vr::TrackedDevicePose_t *poses, uint32_t count) override;
+    bool timeSinceLastVsync(float *seconds, uint64_t *frameCounter) override;
+
+    vr::EVRCompositorError waitGetPoses(vr::TrackedDevicePose_t *poses, uint32_t count) override;
+    vr::EVRCompositorError submit(vr::Hmd_Eye eye, const vr::Texture_t *texture,
+                                  const vr::VRTextureBounds_t *bounds,
+                                  vr::EVRSubmitFlags flags = vr::Submit_Default) override;
+    uint32_t frameTimings(vr::Compositor_FrameTiming *timings, uint32_t count) override;
+    void cumulativeStats(vr::Compositor_CumulativeStats *stats) override;
+    vr::EVRCompositorError mirrorTextureGL(vr::Hmd_Eye eye, vr::glUInt_t *textureId,
+                                           vr::glSharedTextureHandle_t *handle) override;
+    bool releaseMirrorTextureGL(vr::glUInt_t textureId, vr::glSharedTextureHandle_t handle) override;
+    void lockSharedTexture(vr::glSharedTextureHandle_t handle) override;
+    void unlockSharedTexture(vr::glSharedTextureHandle_t handle) override;
+
+private:
+    vr::IVRSystem *m_hmd;
+    vr::IVRCompositor *m_compositor;
+};
+
+#endif // OPENVRBACKEND_H
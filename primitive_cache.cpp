@@ -0,0 +1,222 @@
+﻿#include <QtMath>
+#include "primitive_cache.h"
+
+// position, normal, texcoord
+const int FLOATS_PER_VERTEX = 8;
+
+const int INITIAL_CAPACITY = 4096;
+
+PrimitiveCache::PrimitiveCache()
+    : m_gl(nullptr)
+    ,m_uploaded(0)
+    ,m_capacity(0)
+{
+}
+
+PrimitiveCache::~PrimitiveCache()
+{
+    // GL objects must be released by the owner while its context is current
+}
+
+void PrimitiveCache::init(QOpenGLExtraFunctions *gl)
+{
+    m_gl = gl;
+    m_capacity = INITIAL_CAPACITY;
+    m_arena.reserve(m_capacity * FLOATS_PER_VERTEX);
+
+    m_vbo.setUsagePattern(QOpenGLBuffer::StaticDraw);
+    m_vbo.create();
+    m_vbo.bind();
+    m_vbo.allocate(m_capacity * FLOATS_PER_VERTEX * sizeof(GLfloat));
+
+    m_vao.create();
+    {
+        QOpenGLVertexArrayObject::Binder vaoBind(&m_vao);
+        m_gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)0);
+        m_gl->glEnableVertexAttribArray(0);
+        m_gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(3 * sizeof(float)));
+        m_gl->glEnableVertexAttribArray(1);
+        m_gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, FLOATS_PER_VERTEX * sizeof(float), (void*)(6 * sizeof(float)));
+        m_gl->glEnableVertexAttribArray(2);
+    }
+    m_vbo.release();
+}
+
+void PrimitiveCache::release()
+{
+    m_vao.destroy();
+    m_vbo.destroy();
+    m_meshes.clear();
+    m_arena.clear();
+    m_uploaded = 0;
+    m_gl = nullptr;
+}
+
+/**
+ * 单位圆轮廓, 线段数决定精度
+ **/
+PrimitiveCache::Mesh PrimitiveCache::circle(int segments)
+{
+    segments = qMax(3, segments);
+    const Key key = { Circle, segments, 0, 0.0f };
+    auto it = m_meshes.constFind(key);
+    if (it != m_meshes.constEnd())
+        return it.value();
+
+    Mesh mesh = begin(GL_LINE_LOOP);
+    for (int i = 0; i < segments; ++i) {
+        const float angle = 2.0f * float(M_PI) * i / segments;
+        const float x = qCos(angle);
+        const float y = qSin(angle);
+        vertex(x, y, 0.0f, 0.0f, 0.0f, 1.0f, 0.5f + 0.5f * x, 0.5f - 0.5f * y);
+    }
+    return end(key, mesh);
+}
+
+/**
+ * 外径为1的圆环, innerRadius为内径
+ **/
+PrimitiveCache::Mesh PrimitiveCache::ring(float innerRadius, int segments)
+{
+    segments = qMax(3, segments);
+    innerRadius = qBound(0.0f, innerRadius, 1.0f);
+    const Key key = { Ring, segments, 0, innerRadius };
+    auto it = m_meshes.constFind(key);
+    if (it != m_meshes.constEnd())
+        return it.value();
+
+    Mesh mesh = begin(GL_TRIANGLE_STRIP);
+    for (int i = 0; i <= segments; ++i) {
+        const float angle = 2.0f * float(M_PI) * (i % segments) / segments;
+        const float x = qCos(angle);
+        const float y = qSin(angle);
+        vertex(x, y, 0.0f, 0.0f, 0.0f, 1.0f, 0.5f + 0.5f * x, 0.5f - 0.5f * y);
+        vertex(x * innerRadius, y * innerRadius, 0.0f, 0.0f, 0.0f, 1.0f,
+               0.5f + 0.5f * x * innerRadius, 0.5f - 0.5f * y * innerRadius);
+    }
+    return end(key, mesh);
+}
+
+/**
+ * 单位球, 经纬线划分
+ **/
+PrimitiveCache::Mesh PrimitiveCache::sphere(int rings, int sectors)
+{
+    rings = qMax(2, rings);
+    sectors = qMax(3, sectors);
+    const Key key = { Sphere, rings, sectors, 0.0f };
+    auto it = m_meshes.constFind(key);
+    if (it != m_meshes.constEnd())
+        return it.value();
+
+    auto point = [this, rings, sectors](int ring, int sector) {
+        const float theta = float(M_PI) * ring / rings;
+        const float phi = 2.0f * float(M_PI) * sector / sectors;
+        const float x = qSin(theta) * qCos(phi);
+        const float y = qCos(theta);
+        const float z = qSin(theta) * qSin(phi);
+        vertex(x, y, z, x, y, z, float(sector) / sectors, float(ring) / rings);
+    };
+
+    Mesh mesh = begin(GL_TRIANGLES);
+    for (int r = 0; r < rings; ++r) {
+        for (int s = 0; s < sectors; ++s) {
+            point(r, s);
+            point(r + 1, s);
+            point(r + 1, s + 1);
+            point(r, s);
+            point(r + 1, s + 1);
+            point(r, s + 1);
+        }
+    }
+    return end(key, mesh);
+}
+
+/**
+ * 边长为1的方形网格线, 中心在原点
+ **/
+PrimitiveCache::Mesh PrimitiveCache::grid(int divisions)
+{
+    divisions = qMax(1, divisions);
+    const Key key = { Grid, divisions, 0, 0.0f };
+    auto it = m_meshes.constFind(key);
+    if (it != m_meshes.constEnd())
+        return it.value();
+
+    Mesh mesh = begin(GL_LINES);
+    for (int i = 0; i <= divisions; ++i) {
+        const float t = float(i) / divisions;
+        const float p = t - 0.5f;
+        vertex(p, -0.5f, 0.0f, 0.0f, 0.0f, 1.0f, t, 1.0f);
+        vertex(p, 0.5f, 0.0f, 0.0f, 0.0f, 1.0f, t, 0.0f);
+        vertex(-0.5f, p, 0.0f, 0.0f, 0.0f, 1.0f, 0.0f, 1.0f - t);
+        vertex(0.5f, p, 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f - t);
+    }
+    return end(key, mesh);
+}
+
+/**
+ * 只上传新生成的部分; 容量不足时扩大缓冲并整体重传
+ **/
+void PrimitiveCache::flush()
+{
+    const int vertices = vertexCount();
+    if (!m_gl || m_uploaded == vertices)
+        return;
+
+    m_vbo.bind();
+    if (vertices > m_capacity) {
+        while (m_capacity < vertices)
+            m_capacity *= 2;
+        m_vbo.allocate(m_capacity * FLOATS_PER_VERTEX * sizeof(GLfloat));
+        m_uploaded = 0;
+    }
+    m_vbo.write(m_uploaded * FLOATS_PER_VERTEX * sizeof(GLfloat),
+                m_arena.constData() + m_uploaded * FLOATS_PER_VERTEX,
+                (vertices - m_uploaded) * FLOATS_PER_VERTEX * sizeof(GLfloat));
+    m_vbo.release();
+    m_uploaded = vertices;
+}
+
+void PrimitiveCache::draw(const Mesh &mesh, bool singlePassStereo)
+{
+    if (!m_gl || mesh.isEmpty())
+        return;
+
+    flush();
+    QOpenGLVertexArrayObject::Binder vaoBind(&m_vao);
+    if (singlePassStereo)
+        m_gl->glDrawArraysInstanced(mesh.mode, mesh.first, mesh.count, 2);
+    else
+        m_gl->glDrawArrays(mesh.mode, mesh.first, mesh.count);
+}
+
+int PrimitiveCache::meshCount() const
+{
+    return m_meshes.size();
+}
+
+int PrimitiveCache::vertexCount() const
+{
+    return m_arena.size() / FLOATS_PER_VERTEX;
+}
+
+PrimitiveCache::Mesh PrimitiveCache::begin(GLenum mode)
+{
+    Mesh mesh;
+    mesh.mode = mode;
+    mesh.first = vertexCount();
+    return mesh;
+}
+
+void PrimitiveCache::vertex(float x, float y, float z, float nx, float ny, float nz, float u, float v)
+{
+    m_arena << x << y << z << nx << ny << nz << u << v;
+}
+
+PrimitiveCache::Mesh PrimitiveCache::end(const Key &key, Mesh mesh)
+{
+    mesh.count = vertexCount() - mesh.first;
+    m_meshes.insert(key, mesh);
+    return mesh;
+}
@@ -0,0 +1,84 @@
+﻿#ifndef PRIMITIVECACHE_H
+#define PRIMITIVECACHE_H
+
+#include <QHash>
+#include <QVector>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLVertexArrayObject>
+
+/**
+ * 程序化几何体缓存
+ * Generates circles, rings, spheres and grids into one growing vertex arena
+ * (position/normal/texcoord, the layout of the scene quad) and keeps them
+ * in a single shared VBO. Meshes are cached by their parameters, so asking
+ * for the same primitive again costs a hash lookup: no allocation, no
+ * tessellation and no upload after the first frame it was used.
+ **/
+class PrimitiveCache
+{
+public:
+    // a range of the shared VBO
+    struct Mesh
+    {
+        GLenum mode = GL_TRIANGLES;
+        GLint first = 0;
+        GLsizei count = 0;
+
+        bool isEmpty() const { return count == 0; }
+    };
+
+    PrimitiveCache();
+    ~PrimitiveCache();
+
+    void init(QOpenGLExtraFunctions *gl);
+    void release();
+
+    // unit-space primitives in the xy plane facing +z, scale them with the model matrix
+    Mesh circle(int segments);
+    Mesh ring(float innerRadius, int segments);
+    Mesh sphere(int rings, int sectors);
+    Mesh grid(int divisions);
+
+    // uploads meshes generated since the last flush, called before drawing
+    void flush();
+    void draw(const Mesh &mesh, bool singlePassStereo);
+
+    int meshCount() const;
+    int vertexCount() const;
+
+private:
+    enum Type { Circle, Ring, Sphere, Grid };
+
+    struct Key
+    {
+        int type;
+        int a;
+        int b;
+        float c;
+
+        bool operator==(const Key &other) const
+        {
+            return type == other.type && a == other.a && b == other.b && c == other.c;
+        }
+
+        friend uint qHash(const Key &key, uint seed = 0)
+        {
+            return qHashBits(&key, sizeof(Key), seed);
+        }
+    };
+
+    Mesh begin(GLenum mode);
+    void vertex(float x, float y, float z, float nx, float ny, float nz, float u, float v);
+    Mesh end(const Key &key, Mesh mesh);
+
+    QOpenGLExtraFunctions *m_gl;
+    QOpenGLBuffer m_vbo{QOpenGLBuffer::VertexBuffer};
+    QOpenGLVertexArrayObject m_vao;
+    QHash<Key, Mesh> m_meshes;
+    QVector<GLfloat> m_arena;
+    int m_uploaded;
+    int m_capacity;
+};
+
+#endif // PRIMITIVECACHE_H
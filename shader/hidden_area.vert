@@ -0,0 +1,11 @@
+#version 330 core
+layout (location = 0) in vec2 aPos;
+
+void main()
+{
+    // hidden area mesh is in [0,1] texture space with v pointing down,
+    // it is laid down on the near plane so every later fragment fails the depth test
+    gl_Position = vec4(aPos.x * 2.0 - 1.0, 1.0 - aPos.y * 2.0, -1.0, 1.0);
+    // single-pass stereo keeps GL_CLIP_DISTANCE0 enabled
+    gl_ClipDistance[0] = 1.0;
+}
@@ -0,0 +1,45 @@
+#version 330 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+// the eye images and their rects as (u offset, v offset, u size, v size); both samplers
+// point at the double-wide resolve target, or at the compositor's per-eye mirror textures
+uniform sampler2D leftEye;
+uniform sampler2D rightEye;
+uniform vec4 leftRect;
+uniform vec4 rightRect;
+uniform int mode;
+
+// same values as VRRender::MirrorMode
+const int LEFT_EYE = 0;
+const int RIGHT_EYE = 1;
+const int SIDE_BY_SIDE = 2;
+const int ANAGLYPH = 3;
+
+vec3 sampleLeft(vec2 uv)
+{
+    return texture(leftEye, leftRect.xy + uv * leftRect.zw).rgb;
+}
+
+vec3 sampleRight(vec2 uv)
+{
+    return texture(rightEye, rightRect.xy + uv * rightRect.zw).rgb;
+}
+
+void main()
+{
+    if (mode == LEFT_EYE)
+        FragColor = vec4(sampleLeft(TexCoords), 1.0);
+    else if (mode == RIGHT_EYE)
+        FragColor = vec4(sampleRight(TexCoords), 1.0);
+    else if (mode == SIDE_BY_SIDE)
+        FragColor = TexCoords.x < 0.5 ? vec4(sampleLeft(vec2(TexCoords.x * 2.0, TexCoords.y)), 1.0)
+                                      : vec4(sampleRight(vec2(TexCoords.x * 2.0 - 1.0, TexCoords.y)), 1.0);
+    else if (mode == ANAGLYPH)
+        // red-cyan: red from the left eye, green and blue from the right
+        FragColor = vec4(sampleLeft(TexCoords).r, sampleRight(TexCoords).gb, 1.0);
+    else
+        // both eyes fused
+        FragColor = vec4(mix(sampleLeft(TexCoords), sampleRight(TexCoords), 0.5), 1.0);
+}
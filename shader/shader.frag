@@ -1,29 +1,67 @@
 #version 330 core
 out vec4 FragColor;
 
-struct Material {
-    sampler2D diffuse;
-    sampler2D specular;    
-    float shininess;
-}; 
+// calibration sprites, one layer each: 0 point, 1 red_point, 2 green_point
+uniform sampler2DArray sprites;
+const int HIGHLIGHT_SPRITE = 2;
+
+in vec3 FragPos;  
+in vec2 TexCoords;
+flat in int EyeIndex;
+
+#ifdef INSTANCED
+flat in int Sprite;
+// 1: highlighted
+flat in int State;
+#endif
 
-struct Light {
-    vec3 position;
+#ifdef FLAT_COLOR
+// overlays: one color for the whole draw, no texture
+uniform vec4 flatColor;
+#endif
 
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
+#ifdef LIGHTING
+// static light and material constants
+layout (std140) uniform Lighting
+{
+    vec4 lightPosition;
+    vec4 lightAmbient;
+    vec4 lightDiffuse;
+    vec4 lightSpecular;
+    float shininess;
+};
+
+layout (std140) uniform Camera
+{
+    mat4 view[2];
+    mat4 projection[2];
+    vec4 viewPos[2];
 };
 
-in vec3 FragPos;  
 in vec3 Normal;  
-in vec2 TexCoords;
-  
-uniform vec3 viewPos;
-uniform Material material;
-uniform Light light;
+#endif
 
 void main()
 {	
-    FragColor = texture2D(material.diffuse, TexCoords);
+#ifdef FLAT_COLOR
+    FragColor = flatColor;
+#else
+    // textured variants are always instanced
+    int layer = State == 1 ? HIGHLIGHT_SPRITE : Sprite;
+    vec4 diffuseColor = texture(sprites, vec3(TexCoords, float(layer)));
+#ifdef LIGHTING
+    // the sprite's coverage doubles as its specular map
+    vec3 norm = normalize(Normal);
+    vec3 lightDir = normalize(lightPosition.xyz - FragPos);
+    vec3 viewDir = normalize(viewPos[EyeIndex].xyz - FragPos);
+    vec3 reflectDir = reflect(-lightDir, norm);
+
+    vec3 ambient = lightAmbient.rgb * diffuseColor.rgb;
+    vec3 diffuse = lightDiffuse.rgb * max(dot(norm, lightDir), 0.0) * diffuseColor.rgb;
+    vec3 specular = lightSpecular.rgb * pow(max(dot(viewDir, reflectDir), 0.0), shininess) * diffuseColor.a;
+    FragColor = vec4(ambient + diffuse + specular, diffuseColor.a);
+#else
+    FragColor = diffuseColor;
+#endif
+#endif
 } 
@@ -1,21 +1,79 @@
 #version 330 core
 layout (location = 0) in vec3 aPos;
-layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec2 aTexCoords;
+#ifdef LIGHTING
+layout (location = 1) in vec3 aNormal;
+#endif
+#ifdef INSTANCED
+// per target: xyz position in head space, w scale
+layout (location = 3) in vec4 aTarget;
+// per target: x sprite, y state
+layout (location = 4) in ivec2 aSprite;
+#endif
 
 out vec3 FragPos;
-out vec3 Normal;
 out vec2 TexCoords;
+flat out int EyeIndex;
+#ifdef LIGHTING
+out vec3 Normal;
+#endif
+#ifdef INSTANCED
+flat out int Sprite;
+flat out int State;
+#endif
+
+// per frame, both eyes
+layout (std140) uniform Camera
+{
+    mat4 view[2];
+    mat4 projection[2];
+    vec4 viewPos[2];
+};
+
+// per pass
+layout (std140) uniform Pass
+{
+    // multi-pass: the eye being rendered
+    int eyeIndex;
+    // single-pass: instance 0 is the left eye, instance 1 the right eye,
+    // each squeezed into its half of a double-wide target
+    int singlePassStereo;
+};
 
+// per object
 uniform mat4 model;
-uniform mat4 view;
-uniform mat4 projection;
+#ifdef LIGHTING
+// transpose(inverse(mat3(model))), computed once per object on the CPU
+uniform mat3 normalMatrix;
+#endif
 
 void main()
 {
+    bool stereo = singlePassStereo != 0;
+    int eye = stereo ? gl_InstanceID % 2 : eyeIndex;
+
+#ifdef INSTANCED
+    FragPos = vec3(model * vec4(aTarget.xyz + aPos * aTarget.w, 1.0));
+    Sprite = aSprite.x;
+    State = aSprite.y;
+#else
+    // overlays: plain meshes from the primitive cache
     FragPos = vec3(model * vec4(aPos, 1.0));
-    Normal = mat3(transpose(inverse(model))) * aNormal;  
+#endif
+#ifdef LIGHTING
+    Normal = normalMatrix * aNormal;
+#endif
     TexCoords = aTexCoords;
+    EyeIndex = eye;
     
-    gl_Position = projection * view * vec4(FragPos, 1.0);
-}
\ No newline at end of file
+    gl_Position = projection[eye] * view[eye] * vec4(FragPos, 1.0);
+
+    if (stereo) {
+        // shift into this eye's half and clip everything crossing the seam
+        float offset = eye == 0 ? -0.5 : 0.5;
+        gl_Position.x = gl_Position.x * 0.5 + offset * gl_Position.w;
+        gl_ClipDistance[0] = eye == 0 ? -gl_Position.x : gl_Position.x;
+    } else {
+        gl_ClipDistance[0] = 1.0;
+    }
+}
@@ -0,0 +1,224 @@
+﻿#include <cstring>
+#include <QCryptographicHash>
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QOpenGLContext>
+#include <QOpenGLExtraFunctions>
+#include <QSaveFile>
+#include "shader_variants.h"
+
+// "PBC1", then the binary format and the driver's program binary
+const quint32 BINARY_MAGIC = 0x31434250;
+
+static QByteArray readSource(const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << "unable to open shader" << path;
+        return QByteArray();
+    }
+    return file.readAll();
+}
+
+ShaderVariants::ShaderVariants(const QString &vertexPath, const QString &fragmentPath)
+    : m_vertexPath(vertexPath)
+    ,m_fragmentPath(fragmentPath)
+    ,m_cacheHits(0)
+    ,m_cacheMisses(0)
+{
+}
+
+ShaderVariants::~ShaderVariants()
+{
+    // programs must be released by the owner while its context is current
+    qDeleteAll(m_programs);
+}
+
+QOpenGLShaderProgram *ShaderVariants::program(int features)
+{
+    auto it = m_programs.constFind(features);
+    if (it != m_programs.constEnd())
+        return it.value();
+
+    QOpenGLShaderProgram *program = build(features);
+    // failed variants are cached as well so they are not recompiled every frame
+    m_programs.insert(features, program);
+    return program;
+}
+
+void ShaderVariants::release()
+{
+    qDeleteAll(m_programs);
+    m_programs.clear();
+}
+
+void ShaderVariants::setCacheDirectory(const QString &directory)
+{
+    m_cacheDirectory = directory;
+}
+
+int ShaderVariants::cacheHits() const
+{
+    return m_cacheHits;
+}
+
+int ShaderVariants::cacheMisses() const
+{
+    return m_cacheMisses;
+}
+
+QByteArray ShaderVariants::defines(int features)
+{
+    QByteArray result;
+    if (features & Lighting)
+        result += "#define LIGHTING\n";
+    if (features & Instanced)
+        result += "#define INSTANCED\n";
+    if (features & FlatColor)
+        result += "#define FLAT_COLOR\n";
+    return result;
+}
+
+/**
+ * 在#version行之后插入宏定义, #version必须是第一条语句
+ **/
+QByteArray ShaderVariants::inject(const QByteArray &source, const QByteArray &defines)
+{
+    if (defines.isEmpty())
+        return source;
+
+    int position = 0;
+    const int version = source.indexOf("#version");
+    if (version >= 0) {
+        const int lineEnd = source.indexOf('\n', version);
+        position = lineEnd < 0 ? source.size() : lineEnd + 1;
+    }
+
+    QByteArray result = source;
+    result.insert(position, defines);
+    return result;
+}
+
+QOpenGLShaderProgram *ShaderVariants::build(int features)
+{
+    if (m_vertexSource.isEmpty())
+        m_vertexSource = readSource(m_vertexPath);
+    if (m_fragmentSource.isEmpty())
+        m_fragmentSource = readSource(m_fragmentPath);
+
+    const QByteArray variantDefines = defines(features);
+    const QByteArray vertexSource = inject(m_vertexSource, variantDefines);
+    const QByteArray fragmentSource = inject(m_fragmentSource, variantDefines);
+    const QString path = binaryPath(vertexSource, fragmentSource);
+
+    QOpenGLShaderProgram *program = new QOpenGLShaderProgram;
+    if (!path.isEmpty()) {
+        if (loadBinary(program, path)) {
+            m_cacheHits += 1;
+            return program;
+        }
+        m_cacheMisses += 1;
+        // the failed glProgramBinary leaves the program unusable for sources
+        delete program;
+        program = new QOpenGLShaderProgram;
+    }
+
+    bool success = program->create();
+    if (success && !path.isEmpty())
+        QOpenGLContext::currentContext()->extraFunctions()->glProgramParameteri(
+                    program->programId(), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    success = success && program->addShaderFromSourceCode(QOpenGLShader::Vertex, vertexSource);
+    success = success && program->addShaderFromSourceCode(QOpenGLShader::Fragment, fragmentSource);
+    success = success && program->link();
+    if (!success) {
+        qDebug() << "shader variant" << features << "of" << m_vertexPath << "failed!" << program->log();
+        delete program;
+        return nullptr;
+    }
+
+    if (!path.isEmpty())
+        storeBinary(program, path);
+    return program;
+}
+
+/**
+ * 缓存文件名: 驱动标识与变体源码的哈希, 驱动升级后自动失效
+ **/
+QString ShaderVariants::binaryPath(const QByteArray &vertexSource, const QByteArray &fragmentSource) const
+{
+    QOpenGLContext *context = QOpenGLContext::currentContext();
+    if (m_cacheDirectory.isEmpty() || !context)
+        return QString();
+
+    QOpenGLExtraFunctions *gl = context->extraFunctions();
+    GLint formats = 0;
+    gl->glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    if (formats <= 0)
+        return QString();
+
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_VENDOR)));
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_RENDERER)));
+    hash.addData(reinterpret_cast<const char*>(gl->glGetString(GL_VERSION)));
+    hash.addData(vertexSource);
+    hash.addData(fragmentSource);
+    return m_cacheDirectory + "/" + QString::fromLatin1(hash.result().toHex()) + ".bin";
+}
+
+/**
+ * 没有附加着色器时, link()只检查glProgramBinary的链接状态
+ **/
+bool ShaderVariants::loadBinary(QOpenGLShaderProgram *program, const QString &path)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return false;
+
+    const QByteArray data = file.readAll();
+    quint32 header[2];
+    if (data.size() <= int(sizeof(header)))
+        return false;
+    memcpy(header, data.constData(), sizeof(header));
+    if (header[0] != BINARY_MAGIC)
+        return false;
+
+    if (!program->create())
+        return false;
+    QOpenGLExtraFunctions *gl = QOpenGLContext::currentContext()->extraFunctions();
+    gl->glProgramBinary(program->programId(), header[1], data.constData() + sizeof(header), data.size() - sizeof(header));
+
+    // check first: an empty program may still link as fixed function on a compatibility profile
+    GLint linked = 0;
+    gl->glGetProgramiv(program->programId(), GL_LINK_STATUS, &linked);
+    if (!linked || !program->link()) {
+        // rejected by a newer driver, the recompiled program replaces it
+        file.remove();
+        return false;
+    }
+    return true;
+}
+
+void ShaderVariants::storeBinary(QOpenGLShaderProgram *program, const QString &path)
+{
+    QOpenGLExtraFunctions *gl = QOpenGLContext::currentContext()->extraFunctions();
+    GLint length = 0;
+    gl->glGetProgramiv(program->programId(), GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+        return;
+
+    quint32 header[2] = { BINARY_MAGIC, 0 };
+    QByteArray binary(length, Qt::Uninitialized);
+    GLenum format = 0;
+    gl->glGetProgramBinary(program->programId(), length, &length, &format, binary.data());
+    header[1] = format;
+
+    QDir().mkpath(m_cacheDirectory);
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+    file.write(reinterpret_cast<const char*>(header), sizeof(header));
+    file.write(binary.constData(), length);
+    if (!file.commit())
+        qDebug() << "unable to write program binary" << path;
+}
@@ -0,0 +1,58 @@
+﻿#ifndef SHADERVARIANTS_H
+#define SHADERVARIANTS_H
+
+#include <QByteArray>
+#include <QHash>
+#include <QOpenGLShaderProgram>
+#include <QString>
+
+/**
+ * 着色器变体
+ * One vertex/fragment source pair compiled once per feature set. Each
+ * feature is injected as a #define right after the #version line, so the
+ * sources use plain #ifdef blocks and a draw only pays for what it enables.
+ * With a cache directory set, linked programs are stored as driver binaries
+ * keyed on GL vendor, renderer, version and the variant's source, and later
+ * launches load them back instead of compiling.
+ **/
+class ShaderVariants
+{
+public:
+    enum Feature {
+        Lighting = 0x1,
+        Instanced = 0x2,
+        FlatColor = 0x4
+    };
+
+    ShaderVariants(const QString &vertexPath, const QString &fragmentPath);
+    ~ShaderVariants();
+
+    // compiles and links on first use, nullptr when the variant fails to build
+    QOpenGLShaderProgram *program(int features);
+    void release();
+
+    // program binary cache, disabled while empty
+    void setCacheDirectory(const QString &directory);
+    int cacheHits() const;
+    int cacheMisses() const;
+
+    static QByteArray defines(int features);
+    static QByteArray inject(const QByteArray &source, const QByteArray &defines);
+
+private:
+    QOpenGLShaderProgram *build(int features);
+    QString binaryPath(const QByteArray &vertexSource, const QByteArray &fragmentSource) const;
+    bool loadBinary(QOpenGLShaderProgram *program, const QString &path);
+    void storeBinary(QOpenGLShaderProgram *program, const QString &path);
+
+    QString m_vertexPath;
+    QString m_fragmentPath;
+    QByteArray m_vertexSource;
+    QByteArray m_fragmentSource;
+    QHash<int, QOpenGLShaderProgram*> m_programs;
+    QString m_cacheDirectory;
+    int m_cacheHits;
+    int m_cacheMisses;
+};
+
+#endif // SHADERVARIANTS_H
@@ -0,0 +1,123 @@
+﻿#include <QDebug>
+#include <QImage>
+#include "sprite_atlas.h"
+#include "texture_cache.h"
+
+SpriteAtlas::SpriteAtlas()
+    : m_layers(0)
+    ,m_fromCache(false)
+{
+}
+
+SpriteAtlas::~SpriteAtlas()
+{
+    // the texture must be released by the owner while its context is current
+}
+
+bool SpriteAtlas::load(const QString &cachePath, const QStringList &sources)
+{
+    const QByteArray key = TextureCache::sourceKey(sources);
+
+    TextureCache cache;
+    m_fromCache = !cachePath.isEmpty() && cache.open(cachePath, key);
+    if (m_fromCache) {
+        // straight from the mapped file into the texture
+        m_spriteSize = cache.size();
+        m_layers = cache.layers();
+        allocate(cache.mipLevels());
+        for (int mip = 0; mip < cache.mipLevels(); ++mip)
+            uploadLevel(mip, cache.level(mip));
+        cache.close();
+    } else {
+        QByteArray pixels;
+        if (!decodeSources(sources, pixels))
+            return false;
+
+        const QVector<QByteArray> levels = TextureCache::buildMipChain(pixels, m_spriteSize, m_layers);
+        allocate(levels.size());
+        for (int mip = 0; mip < levels.size(); ++mip)
+            uploadLevel(mip, reinterpret_cast<const uchar*>(levels[mip].constData()));
+        if (!cachePath.isEmpty() && !TextureCache::write(cachePath, key, m_spriteSize, m_layers, levels))
+            qDebug() << "unable to write texture cache" << cachePath;
+    }
+
+    qDebug() << "sprite atlas:" << m_layers << "layers of" << m_spriteSize
+             << (m_fromCache ? "from" : "rebuilt into") << cachePath;
+    return true;
+}
+
+void SpriteAtlas::release()
+{
+    m_texture.reset();
+    m_layers = 0;
+}
+
+void SpriteAtlas::bind(uint unit)
+{
+    if (m_texture)
+        m_texture->bind(unit);
+}
+
+int SpriteAtlas::layers() const
+{
+    return m_layers;
+}
+
+QSize SpriteAtlas::spriteSize() const
+{
+    return m_spriteSize;
+}
+
+bool SpriteAtlas::fromCache() const
+{
+    return m_fromCache;
+}
+
+/**
+ * 解码PNG; 所有层统一为第一张图的尺寸
+ **/
+bool SpriteAtlas::decodeSources(const QStringList &sources, QByteArray &pixels)
+{
+    m_spriteSize = QSize();
+    m_layers = 0;
+    for (const QString &source : sources) {
+        QImage image(source);
+        if (image.isNull()) {
+            qDebug() << "unable to load sprite" << source;
+            return false;
+        }
+        if (!m_spriteSize.isValid())
+            m_spriteSize = image.size();
+        if (image.size() != m_spriteSize)
+            image = image.scaled(m_spriteSize, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        image = image.convertToFormat(QImage::Format_RGBA8888);
+
+        // rows are stored top-down, the way QOpenGLTexture uploads a QImage
+        for (int y = 0; y < image.height(); ++y)
+            pixels.append(reinterpret_cast<const char*>(image.constScanLine(y)), image.width() * 4);
+        m_layers += 1;
+    }
+    return m_layers > 0;
+}
+
+void SpriteAtlas::allocate(int mipLevels)
+{
+    m_texture = std::make_unique<QOpenGLTexture>(QOpenGLTexture::Target2DArray);
+    m_texture->setFormat(QOpenGLTexture::RGBA8_UNorm);
+    m_texture->setSize(m_spriteSize.width(), m_spriteSize.height());
+    m_texture->setLayers(m_layers);
+    m_texture->setMipLevels(mipLevels);
+    m_texture->allocateStorage(QOpenGLTexture::RGBA, QOpenGLTexture::UInt8);
+
+    m_texture->setWrapMode(QOpenGLTexture::ClampToEdge);
+    m_texture->setMinificationFilter(QOpenGLTexture::LinearMipMapLinear);
+    m_texture->setMagnificationFilter(QOpenGLTexture::Linear);
+}
+
+void SpriteAtlas::uploadLevel(int mipLevel, const uchar *pixels)
+{
+    const int layerBytes = TextureCache::levelBytes(m_spriteSize, 1, mipLevel);
+    for (int layer = 0; layer < m_layers; ++layer)
+        m_texture->setData(mipLevel, layer, QOpenGLTexture::RGBA, QOpenGLTexture::UInt8,
+                           pixels + layer * layerBytes);
+}
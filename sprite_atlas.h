@@ -0,0 +1,47 @@
+﻿#ifndef SPRITEATLAS_H
+#define SPRITEATLAS_H
+
+#include <memory>
+#include <QByteArray>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+#include <QOpenGLTexture>
+
+/**
+ * 标定贴图纹理数组
+ * Packs the calibration sprites into one GL_TEXTURE_2D_ARRAY, one layer per
+ * sprite, so targets in any mix of states draw with a single bind and pick
+ * their layer per instance. The layers and their mip chain are kept in a
+ * TextureCache file; while it matches the sources start-up maps it and
+ * uploads it as is, with no PNG decoding and no mipmap generation.
+ **/
+class SpriteAtlas
+{
+public:
+    SpriteAtlas();
+    ~SpriteAtlas();
+
+    // tries cachePath first, otherwise decodes sources and rebuilds cachePath for the next start
+    bool load(const QString &cachePath, const QStringList &sources);
+    void release();
+
+    void bind(uint unit);
+
+    int layers() const;
+    QSize spriteSize() const;
+    bool fromCache() const;
+
+private:
+    bool decodeSources(const QStringList &sources, QByteArray &pixels);
+    void allocate(int mipLevels);
+    void uploadLevel(int mipLevel, const uchar *pixels);
+
+    std::unique_ptr<QOpenGLTexture> m_texture;
+    QSize m_spriteSize;
+    int m_layers;
+    bool m_fromCache;
+};
+
+#endif // SPRITEATLAS_H
@@ -0,0 +1,229 @@
+﻿#include <cstddef>
+#include <cstring>
+#include <QDebug>
+#include <QMutexLocker>
+#include "target_renderer.h"
+
+// per-instance attribute locations, see shader.vert
+const GLuint TARGET_ATTRIBUTE = 3;
+const GLuint SPRITE_ATTRIBUTE = 4;
+
+const int INITIAL_CAPACITY = 64;
+
+TargetRenderer::TargetRenderer()
+    : m_gl(nullptr)
+    ,m_vertexCount(0)
+    ,m_capacity(0)
+    ,m_divisor(0)
+    ,m_dirtyBegin(0)
+    ,m_dirtyEnd(0)
+    ,m_nextId(1)
+{
+}
+
+TargetRenderer::~TargetRenderer()
+{
+    // GL objects must be released by the owner while its context is current
+}
+
+/**
+ * 建立VAO: 顶点属性来自mesh, 实例属性来自实例缓冲
+ **/
+void TargetRenderer::init(QOpenGLExtraFunctions *gl, QOpenGLBuffer *mesh, int vertexCount)
+{
+    m_gl = gl;
+    m_vertexCount = vertexCount;
+    m_capacity = INITIAL_CAPACITY;
+
+    m_instanceBuffer.setUsagePattern(QOpenGLBuffer::DynamicDraw);
+    m_instanceBuffer.create();
+    m_instanceBuffer.bind();
+    m_instanceBuffer.allocate(m_capacity * sizeof(Instance));
+    m_instanceBuffer.release();
+
+    m_vao.create();
+    QOpenGLVertexArrayObject::Binder vaoBind(&m_vao);
+    mesh->bind();
+    m_gl->glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
+    m_gl->glEnableVertexAttribArray(0);
+    m_gl->glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
+    m_gl->glEnableVertexAttribArray(1);
+    m_gl->glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
+    m_gl->glEnableVertexAttribArray(2);
+    mesh->release();
+
+    m_instanceBuffer.bind();
+    m_gl->glVertexAttribPointer(TARGET_ATTRIBUTE, 4, GL_FLOAT, GL_FALSE, sizeof(Instance),
+                                (void*)offsetof(Instance, position));
+    m_gl->glEnableVertexAttribArray(TARGET_ATTRIBUTE);
+    m_gl->glVertexAttribIPointer(SPRITE_ATTRIBUTE, 2, GL_INT, sizeof(Instance),
+                                 (void*)offsetof(Instance, sprite));
+    m_gl->glEnableVertexAttribArray(SPRITE_ATTRIBUTE);
+    m_instanceBuffer.release();
+
+    m_divisor = 0;
+}
+
+void TargetRenderer::release()
+{
+    m_vao.destroy();
+    m_instanceBuffer.destroy();
+    m_gl = nullptr;
+}
+
+int TargetRenderer::addTarget(const QVector3D &position, float scale, int sprite)
+{
+    Edit edit;
+    edit.type = Edit::Add;
+    edit.instance = { { position.x(), position.y(), position.z() }, scale, sprite, Normal };
+
+    QMutexLocker locker(&m_editMutex);
+    edit.id = m_nextId++;
+    m_edits.append(edit);
+    return edit.id;
+}
+
+void TargetRenderer::moveTarget(int id, const QVector3D &position)
+{
+    Edit edit;
+    edit.type = Edit::Move;
+    edit.id = id;
+    edit.instance = { { position.x(), position.y(), position.z() }, 0.0f, 0, Normal };
+
+    QMutexLocker locker(&m_editMutex);
+    m_edits.append(edit);
+}
+
+void TargetRenderer::highlightTarget(int id, bool highlighted)
+{
+    Edit edit;
+    edit.type = Edit::Highlight;
+    edit.id = id;
+    edit.instance = { { 0.0f, 0.0f, 0.0f }, 0.0f, 0, highlighted ? Highlighted : Normal };
+
+    QMutexLocker locker(&m_editMutex);
+    m_edits.append(edit);
+}
+
+void TargetRenderer::removeTarget(int id)
+{
+    Edit edit;
+    edit.type = Edit::Remove;
+    edit.id = id;
+
+    QMutexLocker locker(&m_editMutex);
+    m_edits.append(edit);
+}
+
+/**
+ * 应用排队的修改, 只上传变化的实例区间; 容量不足时整体重建缓冲
+ **/
+void TargetRenderer::update()
+{
+    QVector<Edit> edits;
+    {
+        QMutexLocker locker(&m_editMutex);
+        edits.swap(m_edits);
+    }
+    for (const Edit &edit : edits)
+        apply(edit);
+
+    if (!m_gl || m_dirtyBegin >= m_dirtyEnd)
+        return;
+
+    m_instanceBuffer.bind();
+    if (m_instances.size() > m_capacity) {
+        while (m_capacity < m_instances.size())
+            m_capacity *= 2;
+        m_instanceBuffer.allocate(m_capacity * sizeof(Instance));
+        m_instanceBuffer.write(0, m_instances.constData(), m_instances.size() * sizeof(Instance));
+    } else {
+        m_dirtyEnd = qMin(m_dirtyEnd, m_instances.size());
+        if (m_dirtyBegin < m_dirtyEnd)
+            m_instanceBuffer.write(m_dirtyBegin * sizeof(Instance), m_instances.constData() + m_dirtyBegin,
+                                   (m_dirtyEnd - m_dirtyBegin) * sizeof(Instance));
+    }
+    m_instanceBuffer.release();
+
+    m_dirtyBegin = m_dirtyEnd = 0;
+}
+
+/**
+ * 一次绘制全部靶标; 单遍立体时每个靶标占两个实例, 属性除数为2
+ **/
+void TargetRenderer::draw(bool singlePassStereo)
+{
+    if (!m_gl || m_instances.isEmpty())
+        return;
+
+    QOpenGLVertexArrayObject::Binder vaoBind(&m_vao);
+    const int divisor = singlePassStereo ? 2 : 1;
+    if (m_divisor != divisor) {
+        m_gl->glVertexAttribDivisor(TARGET_ATTRIBUTE, divisor);
+        m_gl->glVertexAttribDivisor(SPRITE_ATTRIBUTE, divisor);
+        m_divisor = divisor;
+    }
+    m_gl->glDrawArraysInstanced(GL_TRIANGLES, 0, m_vertexCount, m_instances.size() * divisor);
+}
+
+int TargetRenderer::count() const
+{
+    return m_instances.size();
+}
+
+void TargetRenderer::apply(const Edit &edit)
+{
+    if (edit.type == Edit::Add) {
+        m_slots.insert(edit.id, m_instances.size());
+        m_ids.append(edit.id);
+        m_instances.append(edit.instance);
+        markDirty(m_instances.size() - 1);
+        return;
+    }
+
+    auto it = m_slots.find(edit.id);
+    if (it == m_slots.end()) {
+        qDebug() << "unknown calibration target" << edit.id;
+        return;
+    }
+    const int slot = it.value();
+    Instance &instance = m_instances[slot];
+
+    switch (edit.type) {
+    case Edit::Move:
+        memcpy(instance.position, edit.instance.position, sizeof(instance.position));
+        markDirty(slot);
+        break;
+    case Edit::Highlight:
+        instance.state = edit.instance.state;
+        markDirty(slot);
+        break;
+    case Edit::Remove: {
+        // the last target fills the hole so the buffer stays packed
+        const int last = m_instances.size() - 1;
+        if (slot != last) {
+            m_instances[slot] = m_instances[last];
+            m_ids[slot] = m_ids[last];
+            m_slots[m_ids[slot]] = slot;
+            markDirty(slot);
+        }
+        m_instances.removeLast();
+        m_ids.removeLast();
+        m_slots.erase(it);
+        break;
+    }
+    default:
+        break;
+    }
+}
+
+void TargetRenderer::markDirty(int slot)
+{
+    if (m_dirtyBegin >= m_dirtyEnd) {
+        m_dirtyBegin = slot;
+        m_dirtyEnd = slot + 1;
+    } else {
+        m_dirtyBegin = qMin(m_dirtyBegin, slot);
+        m_dirtyEnd = qMax(m_dirtyEnd, slot + 1);
+    }
+}
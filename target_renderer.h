@@ -0,0 +1,86 @@
+﻿#ifndef TARGETRENDERER_H
+#define TARGETRENDERER_H
+
+#include <QHash>
+#include <QMutex>
+#include <QVector>
+#include <QVector3D>
+#include <QOpenGLBuffer>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLVertexArrayObject>
+
+/**
+ * 标定靶实例化渲染
+ * Keeps every calibration target in one per-instance buffer (position,
+ * scale, sprite, state) and draws them all with a single instanced call.
+ * Edits may come from any thread; they are queued under a mutex and applied
+ * on the render thread by update(), which re-uploads only the range of
+ * instances that actually changed.
+ **/
+class TargetRenderer
+{
+public:
+    enum State {
+        Normal = 0,
+        Highlighted = 1
+    };
+
+    TargetRenderer();
+    ~TargetRenderer();
+
+    // mesh must hold interleaved position/normal/texcoord vertices
+    void init(QOpenGLExtraFunctions *gl, QOpenGLBuffer *mesh, int vertexCount);
+    void release();
+
+    // any thread; ids stay valid until the target is removed
+    int addTarget(const QVector3D &position, float scale, int sprite);
+    void moveTarget(int id, const QVector3D &position);
+    void highlightTarget(int id, bool highlighted);
+    void removeTarget(int id);
+
+    // render thread, context current
+    void update();
+    void draw(bool singlePassStereo);
+    int count() const;
+
+private:
+    struct Instance
+    {
+        GLfloat position[3];
+        GLfloat scale;
+        GLint sprite;
+        GLint state;
+    };
+
+    struct Edit
+    {
+        enum Type { Add, Move, Highlight, Remove };
+        Type type;
+        int id;
+        Instance instance;
+    };
+
+    void apply(const Edit &edit);
+    void markDirty(int slot);
+
+    QOpenGLExtraFunctions *m_gl;
+    QOpenGLBuffer m_instanceBuffer{QOpenGLBuffer::VertexBuffer};
+    QOpenGLVertexArrayObject m_vao;
+    int m_vertexCount;
+    int m_capacity;
+    int m_divisor;
+
+    // render thread
+    QVector<Instance> m_instances;
+    QVector<int> m_ids;
+    QHash<int, int> m_slots;
+    int m_dirtyBegin;
+    int m_dirtyEnd;
+
+    // shared with the editing threads
+    QMutex m_editMutex;
+    QVector<Edit> m_edits;
+    int m_nextId;
+};
+
+#endif // TARGETRENDERER_H
@@ -0,0 +1,200 @@
+﻿#include <cstring>
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QSaveFile>
+#include "texture_cache.h"
+
+// "TXC1"; fields are in host byte order, the cache never leaves the machine that built it
+const quint32 CACHE_MAGIC = 0x31435854;
+const quint32 CACHE_VERSION = 1;
+const int KEY_SIZE = 32;
+// magic, version, key, width, height, layers, mip levels, padded to 64 bytes
+const int HEADER_SIZE = 64;
+
+TextureCache::TextureCache()
+    : m_data(nullptr)
+    ,m_layers(0)
+{
+}
+
+TextureCache::~TextureCache()
+{
+    close();
+}
+
+bool TextureCache::open(const QString &path, const QByteArray &sourceKey)
+{
+    close();
+    m_file.setFileName(path);
+    if (!m_file.open(QIODevice::ReadOnly) || m_file.size() < HEADER_SIZE)
+        return false;
+
+    const uchar *data = m_file.map(0, m_file.size());
+    if (!data) {
+        qDebug() << "unable to map texture cache" << path;
+        close();
+        return false;
+    }
+
+    quint32 header[4 + KEY_SIZE / 4 + 4];
+    memcpy(header, data, sizeof(header));
+    const quint32 *fields = header + 2 + KEY_SIZE / 4;
+    const QByteArray key = QByteArray(reinterpret_cast<const char*>(data + 8), KEY_SIZE);
+    const QSize size(fields[0], fields[1]);
+    const int layers = fields[2];
+    const int mipLevels = fields[3];
+
+    if (header[0] != CACHE_MAGIC || header[1] != CACHE_VERSION || size.isEmpty() || layers <= 0
+            || mipLevels <= 0 || mipLevels > 32) {
+        qDebug() << "ignoring invalid texture cache" << path;
+        close();
+        return false;
+    }
+    if (key != sourceKey.leftJustified(KEY_SIZE, '\0', true)) {
+        qDebug() << "texture cache" << path << "is stale";
+        close();
+        return false;
+    }
+
+    qint64 offset = HEADER_SIZE;
+    for (int mip = 0; mip < mipLevels; ++mip) {
+        m_levelOffsets.append(offset);
+        offset += levelBytes(size, layers, mip);
+    }
+    if (offset != m_file.size()) {
+        qDebug() << "ignoring truncated texture cache" << path;
+        close();
+        return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_layers = layers;
+    return true;
+}
+
+void TextureCache::close()
+{
+    if (m_data)
+        m_file.unmap(const_cast<uchar*>(m_data));
+    m_file.close();
+    m_data = nullptr;
+    m_size = QSize();
+    m_layers = 0;
+    m_levelOffsets.clear();
+}
+
+QSize TextureCache::size() const
+{
+    return m_size;
+}
+
+int TextureCache::layers() const
+{
+    return m_layers;
+}
+
+int TextureCache::mipLevels() const
+{
+    return m_levelOffsets.size();
+}
+
+const uchar *TextureCache::level(int mipLevel) const
+{
+    if (!m_data || mipLevel < 0 || mipLevel >= m_levelOffsets.size())
+        return nullptr;
+    return m_data + m_levelOffsets[mipLevel];
+}
+
+int TextureCache::levelBytes(const QSize &size, int layers, int mipLevel)
+{
+    const int width = qMax(1, size.width() >> mipLevel);
+    const int height = qMax(1, size.height() >> mipLevel);
+    return width * height * 4 * layers;
+}
+
+QByteArray TextureCache::sourceKey(const QStringList &sources)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    for (const QString &source : sources) {
+        const QFileInfo info(source);
+        hash.addData(source.toUtf8());
+        hash.addData(QByteArray::number(info.size()));
+        hash.addData(QByteArray::number(info.lastModified().toMSecsSinceEpoch()));
+    }
+    return hash.result();
+}
+
+/**
+ * CPU生成mip链; 按alpha加权平均, 透明边缘不会渗出黑边
+ **/
+QVector<QByteArray> TextureCache::buildMipChain(const QByteArray &base, const QSize &size, int layers)
+{
+    QVector<QByteArray> levels;
+    levels.append(base);
+
+    QSize current = size;
+    while (current.width() > 1 || current.height() > 1) {
+        const QSize next(qMax(1, current.width() / 2), qMax(1, current.height() / 2));
+        const QByteArray &source = levels.last();
+        QByteArray target(levelBytes(next, layers, 0), Qt::Uninitialized);
+
+        for (int layer = 0; layer < layers; ++layer) {
+            const uchar *src = reinterpret_cast<const uchar*>(source.constData())
+                    + layer * current.width() * current.height() * 4;
+            uchar *dst = reinterpret_cast<uchar*>(target.data()) + layer * next.width() * next.height() * 4;
+
+            for (int y = 0; y < next.height(); ++y) {
+                for (int x = 0; x < next.width(); ++x) {
+                    int sum[4] = { 0, 0, 0, 0 };
+                    for (int dy = 0; dy < 2; ++dy) {
+                        for (int dx = 0; dx < 2; ++dx) {
+                            const int sx = qMin(x * 2 + dx, current.width() - 1);
+                            const int sy = qMin(y * 2 + dy, current.height() - 1);
+                            const uchar *texel = src + (sy * current.width() + sx) * 4;
+                            for (int c = 0; c < 3; ++c)
+                                sum[c] += texel[c] * texel[3];
+                            sum[3] += texel[3];
+                        }
+                    }
+                    uchar *out = dst + (y * next.width() + x) * 4;
+                    for (int c = 0; c < 3; ++c)
+                        out[c] = sum[3] ? uchar(sum[c] / sum[3]) : 0;
+                    out[3] = uchar((sum[3] + 2) / 4);
+                }
+            }
+        }
+
+        levels.append(target);
+        current = next;
+    }
+    return levels;
+}
+
+bool TextureCache::write(const QString &path, const QByteArray &sourceKey, const QSize &size, int layers,
+                         const QVector<QByteArray> &levels)
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    // a crash mid-write must not leave a cache that open() would accept
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray header(HEADER_SIZE, '\0');
+    const quint32 magic[2] = { CACHE_MAGIC, CACHE_VERSION };
+    const quint32 fields[4] = { quint32(size.width()), quint32(size.height()), quint32(layers), quint32(levels.size()) };
+    memcpy(header.data(), magic, sizeof(magic));
+    memcpy(header.data() + 8, sourceKey.leftJustified(KEY_SIZE, '\0', true).constData(), KEY_SIZE);
+    memcpy(header.data() + 8 + KEY_SIZE, fields, sizeof(fields));
+    file.write(header);
+
+    for (int mip = 0; mip < levels.size(); ++mip) {
+        if (levels[mip].size() != levelBytes(size, layers, mip))
+            return false;
+        file.write(levels[mip]);
+    }
+    return file.commit();
+}
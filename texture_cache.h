@@ -0,0 +1,53 @@
+﻿#ifndef TEXTURECACHE_H
+#define TEXTURECACHE_H
+
+#include <QByteArray>
+#include <QFile>
+#include <QSize>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+/**
+ * 预处理纹理缓存文件
+ * A KTX-like container holding RGBA8 layers together with their complete,
+ * precomputed mip chain. The file is memory-mapped and its levels handed
+ * straight to glTexSubImage, so loading it involves no decoding, no copy
+ * and no glGenerateMipmap. Each file records a key of the sources it was
+ * built from; open() rejects it when the key no longer matches.
+ **/
+class TextureCache
+{
+public:
+    TextureCache();
+    ~TextureCache();
+
+    // false when the file is missing, malformed or was built from other sources
+    bool open(const QString &path, const QByteArray &sourceKey);
+    void close();
+
+    QSize size() const;
+    int layers() const;
+    int mipLevels() const;
+
+    // all layers of one mip level, tightly packed, valid until close()
+    const uchar *level(int mipLevel) const;
+    static int levelBytes(const QSize &size, int layers, int mipLevel);
+
+    // identifies the sources by path, size and modification time without reading them
+    static QByteArray sourceKey(const QStringList &sources);
+
+    // box-filtered mip chain of top-down RGBA8 layers, level 0 included
+    static QVector<QByteArray> buildMipChain(const QByteArray &base, const QSize &size, int layers);
+    static bool write(const QString &path, const QByteArray &sourceKey, const QSize &size, int layers,
+                      const QVector<QByteArray> &levels);
+
+private:
+    QFile m_file;
+    const uchar *m_data;
+    QSize m_size;
+    int m_layers;
+    QVector<qint64> m_levelOffsets;
+};
+
+#endif // TEXTURECACHE_H
@@ -0,0 +1,72 @@
+﻿#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <atomic>
+
+/**
+ * 单生产者/单消费者的无锁三缓冲
+ * The producer fills writeBuffer() and publish()es it; the consumer calls
+ * update() and reads readBuffer(). Neither side ever waits: the middle slot is
+ * swapped atomically and a fresh bit tells the consumer a new value arrived.
+ **/
+template <typename T>
+class TripleBuffer
+{
+public:
+    TripleBuffer()
+        : m_back(2)
+        ,m_front(0)
+        ,m_middle(1)
+    {
+    }
+
+    // producer side
+    T &writeBuffer()
+    {
+        return m_buffers[m_back];
+    }
+
+    void publish()
+    {
+        const int previous = m_middle.exchange(m_back | FRESH_BIT, std::memory_order_acq_rel);
+        m_back = previous & INDEX_MASK;
+    }
+
+    // consumer side, returns true when readBuffer() changed
+    bool update()
+    {
+        if(!(m_middle.load(std::memory_order_acquire) & FRESH_BIT))
+            return false;
+
+        const int previous = m_middle.exchange(m_front, std::memory_order_acq_rel);
+        m_front = previous & INDEX_MASK;
+        return true;
+    }
+
+    const T &readBuffer() const
+    {
+        return m_buffers[m_front];
+    }
+
+    // the consumer may annotate its slot, the producer sees it once the slot comes back
+    T &readBuffer()
+    {
+        return m_buffers[m_front];
+    }
+
+    // direct slot access, only for setup/teardown while neither side is running
+    T &at(int index)
+    {
+        return m_buffers[index];
+    }
+
+private:
+    enum { INDEX_MASK = 0x3, FRESH_BIT = 0x4 };
+
+    T m_buffers[3];
+    int m_back;
+    int m_front;
+    std::atomic<int> m_middle;
+};
+
+#endif // TRIPLEBUFFER_H
@@ -0,0 +1,147 @@
+﻿#include <cstring>
+#include <QDebug>
+#include "uniform_block.h"
+
+UniformBlock::UniformBlock()
+    : m_gl(nullptr)
+    ,m_buffer(0)
+    ,m_binding(0)
+    ,m_dirty(false)
+{
+}
+
+/**
+ * 查询块大小与成员偏移, 创建缓冲并绑定到binding
+ **/
+bool UniformBlock::init(QOpenGLExtraFunctions *gl, QOpenGLShaderProgram *program, const char *blockName,
+                        GLuint binding, const QVector<const char*> &members)
+{
+    m_gl = gl;
+    m_blockName = blockName;
+    m_binding = binding;
+
+    const GLuint programId = program->programId();
+    const GLuint blockIndex = m_gl->glGetUniformBlockIndex(programId, blockName);
+    if (blockIndex == GL_INVALID_INDEX) {
+        qDebug() << "uniform block" << blockName << "not found";
+        return false;
+    }
+
+    GLint blockSize = 0;
+    m_gl->glGetActiveUniformBlockiv(programId, blockIndex, GL_UNIFORM_BLOCK_DATA_SIZE, &blockSize);
+
+    QVector<GLuint> indices(members.size());
+    m_gl->glGetUniformIndices(programId, members.size(), members.constData(), indices.data());
+    for (int i = 0; i < indices.size(); ++i) {
+        if (indices[i] == GL_INVALID_INDEX)
+            qDebug() << "uniform block member" << members[i] << "not found in" << blockName;
+    }
+
+    m_offsets.fill(-1, members.size());
+    m_arrayStrides.fill(0, members.size());
+    m_matrixStrides.fill(0, members.size());
+    for (int i = 0; i < indices.size(); ++i) {
+        if (indices[i] == GL_INVALID_INDEX)
+            continue;
+        m_gl->glGetActiveUniformsiv(programId, 1, &indices[i], GL_UNIFORM_OFFSET, &m_offsets[i]);
+        m_gl->glGetActiveUniformsiv(programId, 1, &indices[i], GL_UNIFORM_ARRAY_STRIDE, &m_arrayStrides[i]);
+        m_gl->glGetActiveUniformsiv(programId, 1, &indices[i], GL_UNIFORM_MATRIX_STRIDE, &m_matrixStrides[i]);
+    }
+
+    m_data.fill(0, blockSize);
+    m_gl->glGenBuffers(1, &m_buffer);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    m_gl->glBufferData(GL_UNIFORM_BUFFER, blockSize, m_data.constData(), GL_DYNAMIC_DRAW);
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_gl->glBindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_buffer);
+    m_dirty = false;
+
+    return attach(program);
+}
+
+void UniformBlock::release()
+{
+    if (m_gl && m_buffer)
+        m_gl->glDeleteBuffers(1, &m_buffer);
+    m_buffer = 0;
+    m_gl = nullptr;
+}
+
+bool UniformBlock::attach(QOpenGLShaderProgram *program) const
+{
+    const GLuint blockIndex = m_gl->glGetUniformBlockIndex(program->programId(), m_blockName.constData());
+    if (blockIndex == GL_INVALID_INDEX)
+        return false;
+    m_gl->glUniformBlockBinding(program->programId(), blockIndex, m_binding);
+    return true;
+}
+
+void UniformBlock::set(int member, const QMatrix4x4 *values, int count)
+{
+    const GLint offset = m_offsets.value(member, -1);
+    if (offset < 0)
+        return;
+
+    // QMatrix4x4 stores column-major floats, as std140 expects
+    for (int i = 0; i < count; ++i) {
+        const float *columns = values[i].constData();
+        for (int column = 0; column < 4; ++column)
+            write(offset + i * m_arrayStrides[member] + column * m_matrixStrides[member],
+                  columns + column * 4, 4 * sizeof(float));
+    }
+}
+
+void UniformBlock::set(int member, const QVector4D *values, int count)
+{
+    const GLint offset = m_offsets.value(member, -1);
+    if (offset < 0)
+        return;
+
+    for (int i = 0; i < count; ++i) {
+        const float vector[4] = { values[i].x(), values[i].y(), values[i].z(), values[i].w() };
+        write(offset + i * m_arrayStrides[member], vector, sizeof(vector));
+    }
+}
+
+void UniformBlock::set(int member, float value)
+{
+    const GLint offset = m_offsets.value(member, -1);
+    if (offset >= 0)
+        write(offset, &value, sizeof(value));
+}
+
+void UniformBlock::set(int member, int value)
+{
+    const GLint offset = m_offsets.value(member, -1);
+    if (offset >= 0)
+        write(offset, &value, sizeof(value));
+}
+
+bool UniformBlock::upload()
+{
+    if (!m_dirty || !m_buffer)
+        return false;
+
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+    m_gl->glBufferSubData(GL_UNIFORM_BUFFER, 0, m_data.size(), m_data.constData());
+    m_gl->glBindBuffer(GL_UNIFORM_BUFFER, 0);
+    m_dirty = false;
+    return true;
+}
+
+GLuint UniformBlock::binding() const
+{
+    return m_binding;
+}
+
+void UniformBlock::write(int offset, const void *data, int size)
+{
+    if (offset + size > m_data.size())
+        return;
+
+    char *target = m_data.data() + offset;
+    if (memcmp(target, data, size) != 0) {
+        memcpy(target, data, size);
+        m_dirty = true;
+    }
+}
@@ -0,0 +1,53 @@
+﻿#ifndef UNIFORMBLOCK_H
+#define UNIFORMBLOCK_H
+
+#include <QByteArray>
+#include <QMatrix4x4>
+#include <QOpenGLExtraFunctions>
+#include <QOpenGLShaderProgram>
+#include <QVector>
+#include <QVector4D>
+
+/**
+ * std140 uniform缓冲
+ * Member offsets and strides are queried once from the program and cached;
+ * set() writes into a CPU-side copy, upload() only touches the buffer when
+ * that copy differs from what the GPU already has.
+ **/
+class UniformBlock
+{
+public:
+    UniformBlock();
+
+    bool init(QOpenGLExtraFunctions *gl, QOpenGLShaderProgram *program, const char *blockName,
+              GLuint binding, const QVector<const char*> &members);
+    void release();
+
+    // attaches another program that declares the same block to this binding point
+    bool attach(QOpenGLShaderProgram *program) const;
+
+    void set(int member, const QMatrix4x4 *values, int count = 1);
+    void set(int member, const QVector4D *values, int count = 1);
+    void set(int member, float value);
+    void set(int member, int value);
+
+    // returns true when the buffer was actually written
+    bool upload();
+
+    GLuint binding() const;
+
+private:
+    void write(int offset, const void *data, int size);
+
+    QOpenGLExtraFunctions *m_gl;
+    QByteArray m_blockName;
+    GLuint m_buffer;
+    GLuint m_binding;
+    QVector<GLint> m_offsets;
+    QVector<GLint> m_arrayStrides;
+    QVector<GLint> m_matrixStrides;
+    QByteArray m_data;
+    bool m_dirty;
+};
+
+#endif // UNIFORMBLOCK_H
@@ -0,0 +1,17 @@
+﻿#include <QDebug>
+#include "vr_backend.h"
+#include "openvr_backend.h"
+#include "mock_vr_backend.h"
+
+VRBackend *VRBackend::create(const QString &name)
+{
+    QString backend = name;
+    if (backend.isEmpty())
+        backend = qEnvironmentVariable("VR_BACKEND", "openvr");
+
+    if (backend == "mock")
+        return new MockVRBackend(qEnvironmentVariableIntValue("VR_MOCK_REFRESH_RATE"));
+    if (backend != "openvr")
+        qWarning() << "unknown VR backend" << backend << ", using openvr";
+    return new OpenVRBackend;
+}
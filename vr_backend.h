@@ -0,0 +1,62 @@
+﻿#ifndef VRBACKEND_H
+#define VRBACKEND_H
+
+#include <QString>
+#include <QVariantMap>
+#include "openvr.h"
+
+/**
+ * VR运行时抽象层
+ * The subset of IVRSystem/IVRCompositor that VRRender uses. OpenVRBackend
+ * forwards to the real runtime, MockVRBackend is an in-process stand-in so
+ * the whole frame loop can run without a headset or SteamVR.
+ **/
+class VRBackend
+{
+public:
+    virtual ~VRBackend() {}
+
+    // returns false and logs the reason when the runtime is not usable
+    virtual bool init() = 0;
+    virtual void shutdown() = 0;
+    virtual QString name() const = 0;
+
+    // IVRSystem
+    virtual vr::HmdMatrix44_t projectionMatrix(vr::Hmd_Eye eye, float nearClip, float farClip) = 0;
+    virtual vr::HmdMatrix34_t eyeToHeadTransform(vr::Hmd_Eye eye) = 0;
+    virtual void recommendedRenderTargetSize(uint32_t *width, uint32_t *height) = 0;
+    virtual vr::HiddenAreaMesh_t hiddenAreaMesh(vr::Hmd_Eye eye) = 0;
+    virtual QString trackedDeviceString(vr::TrackedDeviceIndex_t device,
+                                        vr::TrackedDeviceProperty prop,
+                                        vr::TrackedPropertyError *error = nullptr) = 0;
+    virtual float trackedDeviceFloat(vr::TrackedDeviceIndex_t device,
+                                     vr::TrackedDeviceProperty prop,
+                                     vr::TrackedPropertyError *error = nullptr) = 0;
+    // poses predicted secondsToPhotons ahead of now, for late latching
+    virtual void deviceToAbsoluteTrackingPose(vr::ETrackingUniverseOrigin origin, float secondsToPhotons,
+                                              vr::TrackedDevicePose_t *poses, uint32_t count) = 0;
+    virtual bool timeSinceLastVsync(float *seconds, uint64_t *frameCounter) = 0;
+
+    // IVRCompositor
+    virtual vr::EVRCompositorError waitGetPoses(vr::TrackedDevicePose_t *poses, uint32_t count) = 0;
+    virtual vr::EVRCompositorError submit(vr::Hmd_Eye eye, const vr::Texture_t *texture,
+                                          const vr::VRTextureBounds_t *bounds,
+                                          vr::EVRSubmitFlags flags = vr::Submit_Default) = 0;
+    // oldest to newest, returns the number of entries filled
+    virtual uint32_t frameTimings(vr::Compositor_FrameTiming *timings, uint32_t count) = 0;
+    virtual void cumulativeStats(vr::Compositor_CumulativeStats *stats) = 0;
+    // post-distortion mirror as a GL texture of the current context, lock around every use
+    virtual vr::EVRCompositorError mirrorTextureGL(vr::Hmd_Eye eye, vr::glUInt_t *textureId,
+                                                   vr::glSharedTextureHandle_t *handle) = 0;
+    virtual bool releaseMirrorTextureGL(vr::glUInt_t textureId, vr::glSharedTextureHandle_t handle) = 0;
+    virtual void lockSharedTexture(vr::glSharedTextureHandle_t handle) = 0;
+    virtual void unlockSharedTexture(vr::glSharedTextureHandle_t handle) = 0;
+
+    // backend specific counters, for logs and benchmarks
+    virtual QVariantMap statistics() const { return QVariantMap(); }
+
+    // "openvr" (default) or "mock", overridable with the VR_BACKEND environment variable
+    static VRBackend *create(const QString &name = QString());
+};
+
+#endif // VRBACKEND_H
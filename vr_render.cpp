@@ -1,4 +1,8 @@
 ﻿#include <QDebug>
+#include <QCoreApplication>
+#include <QMetaMethod>
+#include <QStandardPaths>
+#include <QtMath>
 #include "vr_render.h"
 
 const float NEAR_CLIP = 0.1f;
@@ -9,6 +13,9 @@ const float FAR_CLIP = 10000.0f;
 
 
 const float CALIB_DEPTH = 10.0f;
+// fixation ring drawn around the default target
+const float RETICLE_RADIUS = 0.75f;
+const int RETICLE_SEGMENTS = 64;
 // lighting
 static QVector3D lightPos(1.2f, 1.0f, -2.0f);
 
@@ -21,23 +28,93 @@ const float vertices[] = {
     -0.5f, 0.5f, 0.0f,  0.0f,  0.0f, 1.0f,  0.0f, 0.0f,
     -0.5f, -0.5f, 0.0f,  0.0f,  0.0f, 1.0f,  0.0f, 1.0f
 };
+const int VERTEX_COUNT = sizeof(vertices) / (8 * sizeof(float));
+
+// uniform block binding points and members, in the order given to UniformBlock::init()
+enum { CAMERA_BINDING = 0, PASS_BINDING = 1, LIGHTING_BINDING = 2 };
+enum { CAMERA_VIEW, CAMERA_PROJECTION, CAMERA_VIEW_POS };
+enum { PASS_EYE_INDEX, PASS_SINGLE_PASS_STEREO };
+enum { LIGHT_POSITION, LIGHT_AMBIENT, LIGHT_DIFFUSE, LIGHT_SPECULAR, MATERIAL_SHININESS };
+
+// every shader.vert/shader.frag variant the renderer draws with, compiled up front:
+// instanced targets with or without lighting, and the flat-colored overlays
+const int SCENE_VARIANTS[] = { ShaderVariants::Instanced,
+                               ShaderVariants::Lighting | ShaderVariants::Instanced,
+                               ShaderVariants::FlatColor };
+
+// MSAA samples of the eye render targets
+const int EYE_SAMPLES = 4;
+
+// dynamic resolution range, per axis; the targets are allocated at the maximum
+const float MIN_RENDER_SCALE = 0.5f;
+const float MAX_RENDER_SCALE = 1.25f;
+
+// fixed foveation limits: center size as a share of the eye, periphery resolution per axis
+const float MIN_FOVEATION_RADIUS = 0.2f;
+const float MIN_PERIPHERAL_SCALE = 0.25f;
+
+// frames between two profile/telemetry snapshots handed to the GUI thread
+const int STATS_INTERVAL = 25;
 
 
 VRRender::VRRender(QObject *parent)
     : QObject(parent)
     ,m_frame(QImage())
+    ,m_frameSequence(0)
     ,m_frameSize(QSize(0,0))
     ,m_aspectRatio(0)
     ,m_frameCount(0)
     ,m_surfaceFormat(QSurfaceFormat())
     ,m_openGLContext(nullptr)
-    ,m_hmd(nullptr)
+    ,m_sceneShaders(":/shader/shader.vert", ":/shader/shader.frag")
+    ,m_firstFrameNs(-1)
     ,m_leftBuffer(nullptr)
     ,m_rightBuffer(nullptr)
     ,m_resolveBuffer(nullptr)
+    ,m_stereoBuffer(nullptr)
     ,m_eyeWidth(0)
     ,m_eyeHeight(0)
+    ,m_dynamicResolutionEnabled(false)
+    ,m_renderScale(1.0f)
+    ,m_publishedRenderScale(1.0f)
+    ,m_foveation(false)
+    ,m_foveationInnerRadius(0.5f)
+    ,m_foveationPeripheralScale(0.5f)
+    ,m_peripheryBuffer(nullptr)
+    ,m_peripheryResolve(nullptr)
+    ,m_centerBuffer(nullptr)
+    ,m_submitDepth(false)
+    ,m_resolveDepth(0)
+    ,m_lateLatching(false)
+    ,m_frameDuration(1.0f / 90.0f)
+    ,m_vsyncToPhotons(0.0f)
+    ,m_poseLatched(false)
+    ,m_running(false)
+    ,m_frameNotifyPending(false)
+    ,m_readbackDepth(1)
+    ,m_readbackRingSize(3)
+    ,m_readbackEnabled(false)
+    ,m_framePaced(false)
+    ,m_frameWanted(true)
+    ,m_mirrorWidth(0)
+    ,m_mirrorHeight(0)
+    ,m_mirrorMode(LeftEye)
+    ,m_mirrorBuffer(nullptr)
+    ,m_compositorMirror(false)
+    ,m_compositorMirrorTexture{0, 0}
+    ,m_compositorMirrorHandle{nullptr, nullptr}
+    ,m_compositorMirrorFailed(false)
+    ,m_sharedFrameConsumers(0)
+    ,m_sharedFramePending(false)
+    ,m_singlePassStereo(false)
+    ,m_doubleWideTarget(false)
+    ,m_lighting(false)
+    ,m_reticle(false)
+    ,m_hiddenAreaMask(true)
+    ,m_maskedPixelFraction(0.0f)
 {
+    m_startupClock.start();
+
     //   Viewport size
     m_frameSize = QSize(1024,768);
     emit frameSizeChanged(m_frameSize);
@@ -45,27 +122,515 @@ VRRender::VRRender(QObject *parent)
 
     initGL();
     initVR();
+    m_openGLContext.doneCurrent();
+    m_startupStatistics["constructMs"] = m_startupClock.nsecsElapsed() / 1e6;
 }
 
 VRRender::~VRRender()
 {
+    setRunning(false);
     release();
 }
 
+QString VRRender::s_backendName;
+
+/**
+ * 指定后续创建的VRRender使用的运行时, 为空时读取VR_BACKEND环境变量
+ **/
+void VRRender::setBackendName(const QString &name)
+{
+    s_backendName = name;
+}
+
+QString VRRender::s_spriteAtlasPath;
+
+/**
+ * 预打包贴图文件路径, 为空时使用缓存目录下的sprites.atlas
+ **/
+void VRRender::setSpriteAtlasPath(const QString &path)
+{
+    s_spriteAtlasPath = path;
+}
+
+QVariantMap VRRender::startupStatistics() const
+{
+    QVariantMap statistics = m_startupStatistics;
+    const qint64 firstFrameNs = m_firstFrameNs;
+    if (firstFrameNs >= 0)
+        statistics["firstFrameMs"] = firstFrameNs / 1e6;
+    return statistics;
+}
+
+QVariantMap VRRender::backendStatistics() const
+{
+    return m_backend ? m_backend->statistics() : QVariantMap();
+}
+
+QVariantList VRRender::profile() const
+{
+    return m_profile;
+}
+
+/**
+ * 各阶段耗时表, 同时输出到调试日志
+ **/
+QString VRRender::dumpProfile() const
+{
+    QString text = FrameProfiler::format(m_profile);
+    qDebug().noquote() << text;
+    return text;
+}
+
+int VRRender::addTarget(const QVector3D &position, float scale, int sprite)
+{
+    return m_targets.addTarget(position, scale, sprite);
+}
+
+void VRRender::moveTarget(int id, const QVector3D &position)
+{
+    m_targets.moveTarget(id, position);
+}
+
+void VRRender::highlightTarget(int id, bool highlighted)
+{
+    m_targets.highlightTarget(id, highlighted);
+}
+
+void VRRender::removeTarget(int id)
+{
+    m_targets.removeTarget(id);
+}
+
+QVariantMap VRRender::compositorStats() const
+{
+    return m_compositorStats;
+}
+
 QImage VRRender::frame() const
 {
     return m_frame;
 }
 
+int VRRender::frameSequence() const
+{
+    return m_frameSequence;
+}
+
+/**
+ * 镜像视图已显示上一帧, 可以回读下一帧; 调用过一次后回读按此节奏进行
+ **/
+void VRRender::requestFrame()
+{
+    m_framePaced = true;
+    m_frameWanted = true;
+}
+
 QSize VRRender::frameSize() const
 {
     return m_frameSize;
 }
 
+int VRRender::readbackDepth() const
+{
+    return m_readbackDepth;
+}
+
+int VRRender::readbackRingSize() const
+{
+    return m_readbackRingSize;
+}
+
+bool VRRender::running() const
+{
+    return m_running;
+}
+
+/**
+ * 启动/停止渲染线程, 线程运行期间OpenGL上下文归其所有
+ **/
+void VRRender::setRunning(bool running)
+{
+    if (m_running == running)
+        return;
+
+    m_running = running;
+    if (running) {
+        m_renderThread.reset(QThread::create([this]{ renderLoop(); }));
+        m_renderThread->setObjectName("VRRender");
+        m_openGLContext.moveToThread(m_renderThread.get());
+        m_renderThread->start(QThread::TimeCriticalPriority);
+    } else if (m_renderThread) {
+        m_renderThread->wait();
+        m_renderThread.reset();
+    }
+    emit runningChanged(running);
+}
+
+bool VRRender::singlePassStereo() const
+{
+    return m_singlePassStereo;
+}
+
+void VRRender::setSinglePassStereo(bool singlePassStereo)
+{
+    if (m_singlePassStereo == singlePassStereo)
+        return;
+
+    m_singlePassStereo = singlePassStereo;
+    emit singlePassStereoChanged(singlePassStereo);
+}
+
+bool VRRender::doubleWideTarget() const
+{
+    return m_doubleWideTarget;
+}
+
+/**
+ * 多遍渲染时两眼共用一个双倍宽度的MSAA目标, 每帧只解析一次
+ **/
+void VRRender::setDoubleWideTarget(bool doubleWideTarget)
+{
+    if (m_doubleWideTarget == doubleWideTarget)
+        return;
+
+    m_doubleWideTarget = doubleWideTarget;
+    emit doubleWideTargetChanged(doubleWideTarget);
+}
+
+bool VRRender::dynamicResolution() const
+{
+    return m_dynamicResolutionEnabled;
+}
+
+/**
+ * 按GPU耗时调整渲染分辨率; 关闭时恢复为推荐尺寸
+ **/
+void VRRender::setDynamicResolution(bool dynamicResolution)
+{
+    if (m_dynamicResolutionEnabled == dynamicResolution)
+        return;
+
+    m_dynamicResolutionEnabled = dynamicResolution;
+    emit dynamicResolutionChanged(dynamicResolution);
+}
+
+float VRRender::renderScale() const
+{
+    return m_renderScale;
+}
+
+bool VRRender::foveation() const
+{
+    return m_foveation;
+}
+
+/**
+ * 固定注视点渲染, 只作用于多遍渲染; 单遍立体时忽略
+ **/
+void VRRender::setFoveation(bool foveation)
+{
+    if (m_foveation == foveation)
+        return;
+
+    m_foveation = foveation;
+    emit foveationChanged(foveation);
+}
+
+float VRRender::foveationInnerRadius() const
+{
+    return m_foveationInnerRadius;
+}
+
+/**
+ * 全分辨率中心区域占眼睛宽高的比例
+ **/
+void VRRender::setFoveationInnerRadius(float foveationInnerRadius)
+{
+    foveationInnerRadius = qBound(MIN_FOVEATION_RADIUS, foveationInnerRadius, 1.0f);
+    if (qFuzzyCompare(m_foveationInnerRadius, foveationInnerRadius))
+        return;
+
+    m_foveationInnerRadius = foveationInnerRadius;
+    emit foveationInnerRadiusChanged(foveationInnerRadius);
+}
+
+float VRRender::foveationPeripheralScale() const
+{
+    return m_foveationPeripheralScale;
+}
+
+/**
+ * 周边区域每个轴的分辨率比例
+ **/
+void VRRender::setFoveationPeripheralScale(float foveationPeripheralScale)
+{
+    foveationPeripheralScale = qBound(MIN_PERIPHERAL_SCALE, foveationPeripheralScale, 1.0f);
+    if (qFuzzyCompare(m_foveationPeripheralScale, foveationPeripheralScale))
+        return;
+
+    m_foveationPeripheralScale = foveationPeripheralScale;
+    emit foveationPeripheralScaleChanged(foveationPeripheralScale);
+}
+
+bool VRRender::submitDepth() const
+{
+    return m_submitDepth;
+}
+
+/**
+ * 随颜色一并提交深度与渲染位姿, 掉帧时合成器可做位置重投影
+ **/
+void VRRender::setSubmitDepth(bool submitDepth)
+{
+    if (m_submitDepth == submitDepth)
+        return;
+
+    m_submitDepth = submitDepth;
+    emit submitDepthChanged(submitDepth);
+}
+
+bool VRRender::lateLatching() const
+{
+    return m_lateLatching;
+}
+
+/**
+ * CPU准备完成后、发出绘制前重新预测头显位姿, 只更新Camera块
+ **/
+void VRRender::setLateLatching(bool lateLatching)
+{
+    if (m_lateLatching == lateLatching)
+        return;
+
+    m_lateLatching = lateLatching;
+    emit lateLatchingChanged(lateLatching);
+}
+
+bool VRRender::hiddenAreaMask() const
+{
+    return m_hiddenAreaMask;
+}
+
+float VRRender::maskedPixelFraction() const
+{
+    return m_maskedPixelFraction;
+}
+
+void VRRender::setHiddenAreaMask(bool hiddenAreaMask)
+{
+    if (m_hiddenAreaMask == hiddenAreaMask)
+        return;
+
+    m_hiddenAreaMask = hiddenAreaMask;
+    emit hiddenAreaMaskChanged(hiddenAreaMask);
+}
+
+bool VRRender::lighting() const
+{
+    return m_lighting;
+}
+
+/**
+ * 切换着色器变体, 不带光照的变体不读取法线
+ **/
+void VRRender::setLighting(bool lighting)
+{
+    if (m_lighting == lighting)
+        return;
+
+    m_lighting = lighting;
+    emit lightingChanged(lighting);
+}
+
+bool VRRender::reticle() const
+{
+    return m_reticle;
+}
+
+void VRRender::setReticle(bool reticle)
+{
+    if (m_reticle == reticle)
+        return;
+
+    m_reticle = reticle;
+    emit reticleChanged(reticle);
+}
+
+void VRRender::setReadbackDepth(int readbackDepth)
+{
+    readbackDepth = qBound(0, readbackDepth, m_readbackRingSize - 1);
+    if (m_readbackDepth == readbackDepth)
+        return;
+
+    m_readbackDepth = readbackDepth;
+    emit readbackDepthChanged(readbackDepth);
+}
+
+void VRRender::setReadbackRingSize(int readbackRingSize)
+{
+    readbackRingSize = qBound(int(MirrorReadback::MinRingSize), readbackRingSize, int(MirrorReadback::MaxRingSize));
+    if (m_readbackRingSize == readbackRingSize)
+        return;
+
+    m_readbackRingSize = readbackRingSize;
+    emit readbackRingSizeChanged(readbackRingSize);
+    if (m_readbackDepth >= readbackRingSize)
+        setReadbackDepth(readbackRingSize - 1);
+}
+
+QSize VRRender::mirrorSize() const
+{
+    return QSize(m_mirrorWidth, m_mirrorHeight);
+}
+
+/**
+ * 镜像显示区域的像素尺寸, 回读与共享纹理按此缩小; 空尺寸表示不缩小
+ **/
+void VRRender::setMirrorSize(const QSize &mirrorSize)
+{
+    if (this->mirrorSize() == mirrorSize)
+        return;
+
+    m_mirrorWidth = mirrorSize.width();
+    m_mirrorHeight = mirrorSize.height();
+    emit mirrorSizeChanged(mirrorSize);
+}
+
+VRRender::MirrorMode VRRender::mirrorMode() const
+{
+    return MirrorMode(m_mirrorMode.load());
+}
+
+/**
+ * 切换镜像内容不增加回读次数, 只改变GPU上生成镜像的方式
+ **/
+void VRRender::setMirrorMode(MirrorMode mirrorMode)
+{
+    if (m_mirrorMode == mirrorMode)
+        return;
+
+    m_mirrorMode = mirrorMode;
+    emit mirrorModeChanged(mirrorMode);
+}
+
+bool VRRender::compositorMirror() const
+{
+    return m_compositorMirror;
+}
+
+/**
+ * 镜像取自合成器畸变校正后的纹理而非自己的眼睛缓冲, 不可用时退回自己的镜像
+ **/
+void VRRender::setCompositorMirror(bool compositorMirror)
+{
+    if (m_compositorMirror == compositorMirror)
+        return;
+
+    m_compositorMirror = compositorMirror;
+    emit compositorMirrorChanged(compositorMirror);
+}
+
+bool VRRender::sharedTexture() const
+{
+    return QOpenGLContext::areSharing(const_cast<QOpenGLContext*>(&m_openGLContext),
+                                      QOpenGLContext::globalShareContext());
+}
+
+void VRRender::attachSharedFrameConsumer()
+{
+    m_sharedFrameConsumers += 1;
+}
+
+void VRRender::detachSharedFrameConsumer()
+{
+    m_sharedFrameConsumers -= 1;
+}
+
+/**
+ * 取最新的共享镜像纹理, 需在与VRRender共享的上下文中调用
+ **/
+bool VRRender::acquireSharedFrame(GLuint &textureId, QSize &size)
+{
+    m_sharedFrames.update();
+    const SharedFrame &frame = m_sharedFrames.readBuffer();
+    if (!frame.textureId)
+        return false;
+
+    // the GPU of the calling context waits for the blit, the CPU does not
+    if (frame.fence)
+        QOpenGLContext::currentContext()->extraFunctions()->glWaitSync(frame.fence, 0, GL_TIMEOUT_IGNORED);
+
+    textureId = frame.textureId;
+    size = frame.size;
+    return true;
+}
+
+/**
+ * 场景图绘制完成后调用: 在消费者上下文中为当前共享纹理放置栅栏, 生产者复用该槽前在GPU上等待
+ **/
+void VRRender::fenceSharedFrame()
+{
+    SharedFrame &frame = m_sharedFrames.readBuffer();
+    if (!frame.textureId)
+        return;
+
+    QOpenGLExtraFunctions *gl = QOpenGLContext::currentContext()->extraFunctions();
+    if (frame.readFence)
+        gl->glDeleteSync(frame.readFence);
+    frame.readFence = gl->glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // the fence must reach the GPU before the render thread can wait on it
+    gl->glFlush();
+}
+
+/**
+ * 渲染线程在GUI线程取帧后才会再次通知, 避免事件队列堆积
+ **/
+void VRRender::onFrameReady()
+{
+    m_frameNotifyPending = false;
+    if (m_frameBuffer.update()) {
+        m_frame = m_frameBuffer.readBuffer();
+        m_frameSequence += 1;
+        emit frameChanged(m_frame);
+    }
+    if (m_sharedFramePending.exchange(false))
+        emit sharedFrameChanged();
+    if (m_profileBuffer.update()) {
+        m_profile = m_profileBuffer.readBuffer();
+        emit profileChanged(m_profile);
+    }
+    const float renderScale = m_renderScale;
+    if (renderScale != m_publishedRenderScale) {
+        m_publishedRenderScale = renderScale;
+        emit renderScaleChanged(renderScale);
+    }
+    if (m_telemetryBuffer.update()) {
+        m_compositorStats = m_telemetryBuffer.readBuffer();
+        emit compositorStatsChanged(m_compositorStats);
+    }
+}
+
+/**
+ * CPU回读只在有人使用frame属性时进行
+ **/
+void VRRender::connectNotify(const QMetaMethod &signal)
+{
+    if (signal == QMetaMethod::fromSignal(&VRRender::frameChanged))
+        m_readbackEnabled = isSignalConnected(signal);
+}
+
+void VRRender::disconnectNotify(const QMetaMethod &signal)
+{
+    if (signal == QMetaMethod::fromSignal(&VRRender::frameChanged))
+        m_readbackEnabled = isSignalConnected(signal);
+}
+
 void VRRender::initGL()
 {
     //   =======CONTEXT SETUP======
     m_openGLContext.setFormat(m_surfaceFormat);
+    // share with the Qt Quick contexts so MirrorView can sample our textures directly
+    m_openGLContext.setShareContext(QOpenGLContext::globalShareContext());
     m_openGLContext.create();
     if(!m_openGLContext.isValid()) qDebug("Unable to create context");
     m_surface.setFormat(m_surfaceFormat);
@@ -73,160 +638,552 @@ void VRRender::initGL()
     if(!m_surface.isValid()) qDebug("Unable to create the Offscreen surface");
     m_openGLContext.makeCurrent(&m_surface);
     initializeOpenGLFunctions();
+    m_mirrorReadback.init(m_openGLContext.extraFunctions());
+    m_profiler.init();
 
+    const QString cacheDirectory = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QElapsedTimer stageClock;
+    stageClock.start();
+    m_sceneShaders.setCacheDirectory(cacheDirectory + "/shaders");
     createShader();
+    createMirrorShader();
+    m_startupStatistics["shaderMs"] = stageClock.nsecsElapsed() / 1e6;
+    m_startupStatistics["shaderCacheHits"] = m_sceneShaders.cacheHits();
+    m_startupStatistics["shaderCacheMisses"] = m_sceneShaders.cacheMisses();
     vbo.create();
     vbo.bind();
     vbo.allocate(vertices, sizeof(vertices));
+    vbo.release();
 
-    {
-        QOpenGLVertexArrayObject::Binder vaoBind(&cubeVAO);
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)0);
-        glEnableVertexAttribArray(0);
-        glVertexAttribPointer(1, 3, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(3 * sizeof(float)));
-        glEnableVertexAttribArray(1);
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, 8 * sizeof(float), (void*)(6 * sizeof(float)));
-        glEnableVertexAttribArray(2);
-    }
+    // every target shares the quad, the default scene is a single target straight ahead
+    m_targets.init(m_openGLContext.extraFunctions(), &vbo, VERTEX_COUNT);
+    m_targets.addTarget(QVector3D(0.0f, 0.0f, -CALIB_DEPTH), 1.0f, 0);
+    m_primitives.init(m_openGLContext.extraFunctions());
 
-    // load textures (we now use a utility function to keep the code more organized)
+    // load textures, all sprites in one array in the order of VRRender::Sprite
     // -----------------------------------------------------------------------------
-    caliBallTexture = std::make_unique<QOpenGLTexture>(QImage(":/image/point.png"), QOpenGLTexture::GenerateMipMaps);
-    caliBallTexture->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-    caliBallTexture->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::Repeat);
-    caliBallTexture->setMinificationFilter(QOpenGLTexture::Linear);
-    caliBallTexture->setMagnificationFilter(QOpenGLTexture::Linear);
-
-    ballCenterTexture = std::make_unique<QOpenGLTexture>(QImage(":/image/red_point.png"), QOpenGLTexture::GenerateMipMaps);
-    ballCenterTexture->setWrapMode(QOpenGLTexture::DirectionS, QOpenGLTexture::Repeat);
-    ballCenterTexture->setWrapMode(QOpenGLTexture::DirectionT, QOpenGLTexture::Repeat);
-    ballCenterTexture->setMinificationFilter(QOpenGLTexture::Linear);
-    ballCenterTexture->setMagnificationFilter(QOpenGLTexture::Linear);
-
-    // shader configuration
-    // --------------------
-    lightingShader.bind();
-    lightingShader.setUniformValue("material.diffuse", 0);
-    lightingShader.setUniformValue("material.specular", 1);
-    lightingShader.release();
+    QString atlasPath = s_spriteAtlasPath;
+    if (atlasPath.isEmpty())
+        atlasPath = cacheDirectory + "/sprites.atlas";
+    stageClock.restart();
+    m_sprites.load(atlasPath, { ":/image/point.png", ":/image/red_point.png", ":/image/green_point.png" });
+    m_startupStatistics["textureMs"] = stageClock.nsecsElapsed() / 1e6;
+    m_startupStatistics["textureCacheHit"] = m_sprites.fromCache();
+
+    initUniformBlocks();
 
-    vbo.release();
     glEnable(GL_DEPTH_TEST);
 }
 
 void VRRender::initVR()
 {
-    vr::EVRInitError error = vr::VRInitError_None;
-    m_hmd = vr::VR_Init(&error, vr::VRApplication_Scene);
-
-    if (error != vr::VRInitError_None)
+    m_backend.reset(VRBackend::create(s_backendName));
+    if (!m_backend->init())
     {
-        m_hmd = 0;
-        QString message = vr::VR_GetVRInitErrorAsEnglishDescription(error);
-        qCritical() << message;
+        m_backend.reset();
         return;
     }
+    qDebug() << "VR backend:" << m_backend->name();
 
     // get eye matrices
-    m_rightProjection = vrMatrixToQt(m_hmd->GetProjectionMatrix(vr::Eye_Right, NEAR_CLIP, FAR_CLIP));
-    m_rightPose = vrMatrixToQt(m_hmd->GetEyeToHeadTransform(vr::Eye_Right)).inverted();
+    m_eyeProjection[vr::Eye_Left] = m_backend->projectionMatrix(vr::Eye_Left, NEAR_CLIP, FAR_CLIP);
+    m_eyeProjection[vr::Eye_Right] = m_backend->projectionMatrix(vr::Eye_Right, NEAR_CLIP, FAR_CLIP);
+
+    m_rightProjection = vrMatrixToQt(m_eyeProjection[vr::Eye_Right]);
+    m_rightPose = vrMatrixToQt(m_backend->eyeToHeadTransform(vr::Eye_Right)).inverted();
 
-    m_leftProjection = vrMatrixToQt(m_hmd->GetProjectionMatrix(vr::Eye_Left, NEAR_CLIP, FAR_CLIP));
-    m_leftPose = vrMatrixToQt(m_hmd->GetEyeToHeadTransform(vr::Eye_Left)).inverted();
+    m_leftProjection = vrMatrixToQt(m_eyeProjection[vr::Eye_Left]);
+    m_leftPose = vrMatrixToQt(m_backend->eyeToHeadTransform(vr::Eye_Left)).inverted();
+    m_renderPose = {{ { 1.0f, 0.0f, 0.0f, 0.0f }, { 0.0f, 1.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 1.0f, 0.0f } }};
 
     QString device = getTrackedDeviceString(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_TrackingSystemName_String);
     QString serialNum = getTrackedDeviceString(vr::k_unTrackedDeviceIndex_Hmd, vr::Prop_SerialNumber_String);
     qDebug() << "device: " << device << "serialNumber: " << serialNum;
 
-    // setup frame buffers for eyes
-    m_hmd->GetRecommendedRenderTargetSize(&m_eyeWidth, &m_eyeHeight);
+    loadHiddenAreaMesh();
 
-    QOpenGLFramebufferObjectFormat buffFormat;
-    buffFormat.setAttachment(QOpenGLFramebufferObject::Depth);
-    buffFormat.setInternalTextureFormat(GL_RGBA8);
-    buffFormat.setSamples(4);
-
-    m_leftBuffer = new QOpenGLFramebufferObject(m_eyeWidth, m_eyeHeight, buffFormat);
-    m_rightBuffer = new QOpenGLFramebufferObject(m_eyeWidth, m_eyeHeight, buffFormat);
-
-    QOpenGLFramebufferObjectFormat resolveFormat;
-    resolveFormat.setInternalTextureFormat(GL_RGBA8);
-    buffFormat.setSamples(0);
+    // setup frame buffers for eyes
+    // the targets are created on first use by updateEyeTargets()
+    m_backend->recommendedRenderTargetSize(&m_eyeWidth, &m_eyeHeight);
+    m_targetSize = m_renderSize = QSize(m_eyeWidth, m_eyeHeight);
+
+    vr::TrackedPropertyError error = vr::TrackedProp_Success;
+    float refreshRate = m_backend->trackedDeviceFloat(vr::k_unTrackedDeviceIndex_Hmd,
+                                                      vr::Prop_DisplayFrequency_Float, &error);
+    if (error != vr::TrackedProp_Success || refreshRate <= 0.0f)
+        refreshRate = 90.0f;
+    m_dynamicResolution.setRefreshRate(refreshRate);
+    m_frameDuration = 1.0f / refreshRate;
+    m_vsyncToPhotons = m_backend->trackedDeviceFloat(vr::k_unTrackedDeviceIndex_Hmd,
+                                                     vr::Prop_SecondsFromVsyncToPhotons_Float, &error);
+    if (error != vr::TrackedProp_Success || m_vsyncToPhotons < 0.0f)
+        m_vsyncToPhotons = 0.0f;
+    m_dynamicResolution.setRange(MIN_RENDER_SCALE, MAX_RENDER_SCALE);
+    qDebug() << "refresh rate:" << refreshRate << "Hz, eye GPU budget" << m_dynamicResolution.budgetMs() << "ms";
+
+    updateEyeTargets(m_singlePassStereo || m_doubleWideTarget, false);
+}
 
-    m_resolveBuffer = new QOpenGLFramebufferObject(m_eyeWidth*2, m_eyeHeight, resolveFormat);
+void VRRender::renderLoop()
+{
+    m_openGLContext.makeCurrent(&m_surface);
 
-    // turn on compositor
-    if (!vr::VRCompositor())
-    {
-        QString message = "Compositor initialization failed. See log file for details";
-        qCritical() << message;
-        return;
+    while (m_running) {
+        // without a headset there is no WaitGetPoses to pace the loop
+        if (!m_backend)
+            QThread::msleep(10);
+        renderImage();
     }
+
+    m_openGLContext.doneCurrent();
+    m_openGLContext.moveToThread(qApp->thread());
 }
 
 void VRRender::renderImage()
 {
-    if (m_hmd)
+    m_profiler.beginFrame();
+
+    if (m_backend)
     {
+        m_profiler.begin(FrameProfiler::PoseWait, false);
         updatePoses();
+        m_profiler.end(FrameProfiler::PoseWait);
+        updateCameraBlock();
+        m_targets.update();
+
         glClear(GL_COLOR_BUFFER_BIT|GL_DEPTH_BUFFER_BIT);
         glClearColor(0.15f, 0.15f, 0.18f, 1.0f);
-        glViewport(0, 0, m_eyeWidth, m_eyeHeight);
 
-        QRect sourceRect(0, 0, m_eyeWidth, m_eyeHeight);
+        const bool doubleWide = m_singlePassStereo || m_doubleWideTarget;
+        const bool foveated = m_foveation && !m_singlePassStereo;
+        const bool depth = m_submitDepth;
+        const GLbitfield resolveBits = GL_COLOR_BUFFER_BIT | (depth ? GL_DEPTH_BUFFER_BIT : 0);
+        updateRenderSize();
+        updateEyeTargets(doubleWide, foveated);
+        updateResolveDepth(depth);
+        glViewport(0, 0, m_renderSize.width(), m_renderSize.height());
+
+        // all CPU work for the frame is done, nothing after this depends on the pose but the draws
+        if (m_lateLatching)
+            latchPoses();
+
+        // both eyes packed side by side at the bottom left of every target
+        QRect sourceRect(QPoint(0, 0), m_renderSize);
+        if (foveated)
+        {
+            // each eye is composited straight into the resolve target
+            m_profiler.begin(FrameProfiler::LeftEye);
+            renderFoveatedEye(vr::Eye_Left, sourceRect, depth);
+            m_profiler.end(FrameProfiler::LeftEye);
+
+            m_profiler.begin(FrameProfiler::RightEye);
+            renderFoveatedEye(vr::Eye_Right, sourceRect.translated(m_renderSize.width(), 0), depth);
+            m_profiler.end(FrameProfiler::RightEye);
+        }
+        else if (doubleWide)
+        {
+            if (m_singlePassStereo) {
+                m_profiler.begin(FrameProfiler::StereoEyes);
+                renderStereo();
+                m_profiler.end(FrameProfiler::StereoEyes);
+            } else {
+                renderDoubleWide();
+            }
+
+            m_profiler.begin(FrameProfiler::Resolve);
+            QRect stereoRect(0, 0, m_renderSize.width()*2, m_renderSize.height());
+            QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, stereoRect,
+                                                      m_stereoBuffer, stereoRect, resolveBits);
+            m_profiler.end(FrameProfiler::Resolve);
+        }
+        else
+        {
+            m_profiler.begin(FrameProfiler::LeftEye);
+            glEnable(GL_MULTISAMPLE);
+            m_leftBuffer->bind();
+            renderEye(vr::Eye_Left);
+            m_leftBuffer->release();
+            m_profiler.end(FrameProfiler::LeftEye);
+
+            m_profiler.begin(FrameProfiler::RightEye);
+            glEnable(GL_MULTISAMPLE);
+            m_rightBuffer->bind();
+            renderEye(vr::Eye_Right);
+            m_rightBuffer->release();
+            m_profiler.end(FrameProfiler::RightEye);
+
+            m_profiler.begin(FrameProfiler::Resolve);
+            QRect targetLeft = sourceRect;
+            QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, targetLeft,
+                                                      m_leftBuffer, sourceRect, resolveBits);
+            QRect targetRight = sourceRect.translated(m_renderSize.width(), 0);
+            QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, targetRight,
+                                                      m_rightBuffer, sourceRect, resolveBits);
+            m_profiler.end(FrameProfiler::Resolve);
+        }
+    }
+
+    if (m_backend)
+    {
+        m_profiler.begin(FrameProfiler::Submit);
+        submitEyes(m_resolveDepth != 0, m_poseLatched);
+        m_profiler.end(FrameProfiler::Submit);
+
+        m_telemetry.frameSubmitted(m_backend.get(), m_frameCount);
+    }
+
+    if(m_resolveBuffer){
+        m_profiler.begin(FrameProfiler::Mirror);
+        // a paced view that has not shown the last frame yet gets no new readback;
+        // the request is consumed by the one readback queued for it
+        const bool share = m_sharedFrameConsumers > 0;
+        const bool paced = m_framePaced;
+        const bool wanted = paced && m_readbackEnabled && m_frameWanted.exchange(false);
+        const bool queue = m_readbackEnabled && (!paced || wanted);
+        QRect mirrorRect;
+        QOpenGLFramebufferObject *mirror = nullptr;
+        if(share || queue)
+            mirror = downscaleMirror(mirrorSource(mirrorRect), mirrorRect);
+        if(share)
+            publishSharedFrame(mirror, mirrorRect);
+        // nothing could be queued, keep the request for the next frame
+        if(wanted && !mirror)
+            m_frameWanted = true;
+        if(m_readbackEnabled)
+            readbackFrame(queue ? mirror : nullptr, mirrorRect, paced);
+        m_profiler.end(FrameProfiler::Mirror);
+    }
+
+    m_profiler.endFrame();
+
+    if (m_firstFrameNs < 0) {
+        glFinish();
+        m_firstFrameNs = m_startupClock.nsecsElapsed();
+        qDebug() << "cold start to first frame:" << m_firstFrameNs / 1e6 << "ms";
+    }
+
+    m_frameCount += 1;
+
+    if(m_frameCount % STATS_INTERVAL == 0){
+        m_profileBuffer.writeBuffer() = m_profiler.snapshot();
+        m_profileBuffer.publish();
+        if(m_backend){
+            m_telemetry.pull(m_backend.get());
+            m_telemetryBuffer.writeBuffer() = m_telemetry.snapshot();
+            m_telemetryBuffer.publish();
+        }
+        notifyFrameReady();
+    }
+}
+
+bool VRRender::createMirrorShader()
+{
+    bool success = m_mirrorShader.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shader/mirror.vert");
+    success = success && m_mirrorShader.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shader/mirror.frag");
+    success = success && m_mirrorShader.link();
+    if (!success) {
+        qDebug() << "mirror shader failed!" << m_mirrorShader.log();
+        return false;
+    }
+
+    m_mirrorShader.bind();
+    m_mirrorShader.setUniformValue("leftEye", 0);
+    m_mirrorShader.setUniformValue("rightEye", 1);
+    m_mirrorShader.release();
+    // the full-screen triangle has no attributes, but the core profile still needs a VAO
+    m_mirrorVAO.create();
+    return true;
+}
 
-        glEnable(GL_MULTISAMPLE);
-        m_leftBuffer->bind();
-        renderEye(vr::Eye_Left);
-        m_leftBuffer->release();
-        QRect targetLeft(0, 0, m_eyeWidth, m_eyeHeight);
-        QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, targetLeft,
-                                                  m_leftBuffer, sourceRect);
+/**
+ * 按镜像模式取镜像内容: 单眼与并排直接引用解析目标的区域, 红青立体与融合各需一次全屏绘制
+ **/
+QOpenGLFramebufferObject *VRRender::mirrorSource(QRect &rect)
+{
+    const int width = m_renderSize.width();
+    const int height = m_renderSize.height();
+    const int mode = m_mirrorMode;
+    if (m_compositorMirror) {
+        if (QOpenGLFramebufferObject *mirror = compositorMirrorSource(mode, rect))
+            return mirror;
+    } else {
+        releaseCompositorMirror();
+    }
 
-        glEnable(GL_MULTISAMPLE);
-        m_rightBuffer->bind();
-        renderEye(vr::Eye_Right);
-        m_rightBuffer->release();
-        QRect targetRight(m_eyeWidth, 0, m_eyeWidth, m_eyeHeight);
-        QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, targetRight,
-                                                  m_rightBuffer, sourceRect);
+    rect = QRect(0, 0, width, height);
+    if (mode == RightEye)
+        rect.translate(width, 0);
+    else if (mode == SideBySide)
+        rect.setWidth(width * 2);
+    if ((mode != Anaglyph && mode != Composite) || !m_mirrorShader.isLinked()) {
+        SAFE_DELETE(m_mirrorBuffer);
+        return m_resolveBuffer;
     }
 
-    if (m_hmd)
+    // eye rects in texture coordinates of the double-wide resolve target
+    const float uSize = float(width) / m_resolveBuffer->width();
+    const float vSize = float(height) / m_resolveBuffer->height();
+    drawMirror(mode, m_resolveBuffer->texture(), m_resolveBuffer->texture(),
+               QVector4D(0.0f, 0.0f, uSize, vSize), QVector4D(uSize, 0.0f, uSize, vSize), m_renderSize);
+    return m_mirrorBuffer;
+}
+
+/**
+ * 一次全屏绘制把两眼图像按镜像模式合成到m_mirrorBuffer
+ **/
+void VRRender::drawMirror(int mode, GLuint leftTexture, GLuint rightTexture,
+                          const QVector4D &leftRect, const QVector4D &rightRect, const QSize &size)
+{
+    if (!m_mirrorBuffer || m_mirrorBuffer->size() != size) {
+        SAFE_DELETE(m_mirrorBuffer);
+        QOpenGLFramebufferObjectFormat format;
+        format.setInternalTextureFormat(GL_RGBA8);
+        m_mirrorBuffer = new QOpenGLFramebufferObject(size, format);
+    }
+
+    m_mirrorBuffer->bind();
+    glViewport(0, 0, size.width(), size.height());
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_BLEND);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, rightTexture);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, leftTexture);
+    m_mirrorShader.bind();
+    m_mirrorShader.setUniformValue("leftRect", leftRect);
+    m_mirrorShader.setUniformValue("rightRect", rightRect);
+    m_mirrorShader.setUniformValue("mode", mode);
     {
-        vr::VRTextureBounds_t leftRect = { 0.0f, 0.0f, 0.5f, 1.0f };
-        vr::VRTextureBounds_t rightRect = { 0.5f, 0.0f, 1.0f, 1.0f };
-        vr::Texture_t composite = { (void*)m_resolveBuffer->texture(), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
+        QOpenGLVertexArrayObject::Binder vaoBind(&m_mirrorVAO);
+        glDrawArrays(GL_TRIANGLES, 0, 3);
+    }
+    m_mirrorShader.release();
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_mirrorBuffer->release();
+}
 
-        vr::VRCompositor()->Submit(vr::Eye_Left, &composite, &leftRect);
-        vr::VRCompositor()->Submit(vr::Eye_Right, &composite, &rightRect);
+/**
+ * 合成器畸变校正后的镜像纹理, 即用户实际看到的画面; 取用期间需加锁
+ **/
+QOpenGLFramebufferObject *VRRender::compositorMirrorSource(int mode, QRect &rect)
+{
+    if (!m_backend || !m_mirrorShader.isLinked() || m_compositorMirrorFailed)
+        return nullptr;
+
+    const bool left = mode != RightEye;
+    const bool right = mode != LeftEye;
+    if ((left && !acquireCompositorMirror(vr::Eye_Left)) || (right && !acquireCompositorMirror(vr::Eye_Right)))
+        return nullptr;
+
+    const int sizeEye = left ? vr::Eye_Left : vr::Eye_Right;
+    QSize size = m_compositorMirrorSize[sizeEye];
+    if (mode == SideBySide)
+        size.setWidth(size.width() * 2);
+
+    const GLuint leftTexture = m_compositorMirrorTexture[left ? vr::Eye_Left : vr::Eye_Right];
+    const GLuint rightTexture = m_compositorMirrorTexture[right ? vr::Eye_Right : vr::Eye_Left];
+    const QVector4D whole(0.0f, 0.0f, 1.0f, 1.0f);
+    if (left)
+        m_backend->lockSharedTexture(m_compositorMirrorHandle[vr::Eye_Left]);
+    if (right)
+        m_backend->lockSharedTexture(m_compositorMirrorHandle[vr::Eye_Right]);
+    drawMirror(mode, leftTexture, rightTexture, whole, whole, size);
+    if (right)
+        m_backend->unlockSharedTexture(m_compositorMirrorHandle[vr::Eye_Right]);
+    if (left)
+        m_backend->unlockSharedTexture(m_compositorMirrorHandle[vr::Eye_Left]);
+
+    rect = QRect(QPoint(0, 0), size);
+    return m_mirrorBuffer;
+}
+
+bool VRRender::acquireCompositorMirror(vr::Hmd_Eye eye)
+{
+    if (m_compositorMirrorTexture[eye])
+        return true;
+
+    vr::EVRCompositorError error = m_backend->mirrorTextureGL(eye, &m_compositorMirrorTexture[eye],
+                                                              &m_compositorMirrorHandle[eye]);
+    if (error != vr::VRCompositorError_None || !m_compositorMirrorTexture[eye]) {
+        // reported once, the own mirror is used until the option is toggled
+        if (!m_compositorMirrorFailed)
+            qDebug() << "compositor mirror texture unavailable:" << error;
+        m_compositorMirrorFailed = true;
+        m_compositorMirrorTexture[eye] = 0;
+        m_compositorMirrorHandle[eye] = nullptr;
+        return false;
     }
 
-    if(m_leftBuffer){
-        m_frame = m_leftBuffer->toImage();
-        emit frameChanged(m_frame);
+    GLint width = 0, height = 0;
+    glBindTexture(GL_TEXTURE_2D, m_compositorMirrorTexture[eye]);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+    glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_compositorMirrorSize[eye] = QSize(qMax(1, width), qMax(1, height));
+    return true;
+}
+
+void VRRender::releaseCompositorMirror()
+{
+    m_compositorMirrorFailed = false;
+    for (int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye) {
+        if (!m_compositorMirrorTexture[eye])
+            continue;
+        if (m_backend)
+            m_backend->releaseMirrorTextureGL(m_compositorMirrorTexture[eye], m_compositorMirrorHandle[eye]);
+        m_compositorMirrorTexture[eye] = 0;
+        m_compositorMirrorHandle[eye] = nullptr;
     }
+}
 
-    m_frameCount += 1;
-    if(m_frameCount > 100)
-        m_frameCount = 0;
+/**
+ * 镜像按视图尺寸逐级减半缩小, 每级不超过2:1使线性过滤等效于盒式滤波; rect输入源区域, 输出结果区域
+ **/
+QOpenGLFramebufferObject *VRRender::downscaleMirror(QOpenGLFramebufferObject *source, QRect &rect)
+{
+    const QSize view(m_mirrorWidth, m_mirrorHeight);
+    QSize size = rect.size();
+    if (!view.isEmpty() && (size.width() > view.width() || size.height() > view.height()))
+        size = size.scaled(view, Qt::KeepAspectRatio).expandedTo(QSize(1, 1));
+
+    QOpenGLFramebufferObjectFormat format;
+    format.setInternalTextureFormat(GL_RGBA8);
+
+    int level = 0;
+    QSize step = rect.size();
+    while (step != size) {
+        step = QSize(qMax(size.width(), step.width() / 2), qMax(size.height(), step.height() / 2));
+        if (level == m_mirrorChain.size())
+            m_mirrorChain.append(nullptr);
+        QOpenGLFramebufferObject *&target = m_mirrorChain[level];
+        if (!target || target->size() != step) {
+            delete target;
+            target = new QOpenGLFramebufferObject(step, format);
+        }
+
+        const QRect targetRect(QPoint(0, 0), step);
+        QOpenGLFramebufferObject::blitFramebuffer(target, targetRect, source, rect,
+                                                  GL_COLOR_BUFFER_BIT, GL_LINEAR);
+        source = target;
+        rect = targetRect;
+        level += 1;
+    }
+    while (m_mirrorChain.size() > level)
+        delete m_mirrorChain.takeLast();
+    return source;
+}
+
+/**
+ * 将镜像图像拷贝到共享纹理, 供场景图直接采样
+ **/
+void VRRender::publishSharedFrame(QOpenGLFramebufferObject *source, const QRect &sourceRect)
+{
+    SharedFrame &frame = m_sharedFrames.writeBuffer();
+    if (frame.fence) {
+        glDeleteSync(frame.fence);
+        frame.fence = nullptr;
+    }
+    // the scene graph may still be sampling this slot from its last frame
+    if (frame.readFence) {
+        glWaitSync(frame.readFence, 0, GL_TIMEOUT_IGNORED);
+        glDeleteSync(frame.readFence);
+        frame.readFence = nullptr;
+    }
+    if (!frame.buffer || frame.buffer->size() != sourceRect.size()) {
+        delete frame.buffer;
+        QOpenGLFramebufferObjectFormat format;
+        format.setInternalTextureFormat(GL_RGBA8);
+        frame.buffer = new QOpenGLFramebufferObject(sourceRect.size(), format);
+        frame.textureId = frame.buffer->texture();
+        frame.size = sourceRect.size();
+    }
+
+    QOpenGLFramebufferObject::blitFramebuffer(frame.buffer, QRect(QPoint(0, 0), sourceRect.size()),
+                                              source, sourceRect);
+    frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    // the fence must reach the GPU before another context can wait on it
+    glFlush();
+
+    m_sharedFrames.publish();
+    m_sharedFramePending = true;
+    notifyFrameReady();
+}
+
+/**
+ * 镜像图像异步回读, 延迟readbackDepth帧; 按视图节奏回读时, 没有新帧排队则不必等待深度
+ **/
+void VRRender::readbackFrame(QOpenGLFramebufferObject *source, const QRect &sourceRect, bool paced)
+{
+    m_mirrorReadback.setRingSize(m_readbackRingSize);
+    m_mirrorReadback.setReadbackDepth(m_readbackDepth);
+    // without a source only frames already in flight are collected
+    m_mirrorReadback.queue(source, sourceRect);
+    if(m_mirrorReadback.take(m_frameBuffer.writeBuffer(), paced && !source)){
+        m_frameBuffer.publish();
+        notifyFrameReady();
+    }
+}
+
+void VRRender::notifyFrameReady()
+{
+    if(!m_frameNotifyPending.exchange(true))
+        QMetaObject::invokeMethod(this, "onFrameReady", Qt::QueuedConnection);
 }
 
 void VRRender::release()
 {
+    m_openGLContext.makeCurrent(&m_surface);
+    m_mirrorReadback.release();
+    m_profiler.release();
+    m_targets.release();
+    m_primitives.release();
+    m_sprites.release();
+    m_sceneShaders.release();
+    m_scenePrograms.clear();
+    m_cameraBlock.release();
+    m_passBlock.release();
+    m_lightingBlock.release();
+    for (int i = 0; i < 3; ++i) {
+        SharedFrame &frame = m_sharedFrames.at(i);
+        if (frame.fence)
+            glDeleteSync(frame.fence);
+        if (frame.readFence)
+            glDeleteSync(frame.readFence);
+        SAFE_DELETE(frame.buffer);
+        frame = SharedFrame();
+    }
     SAFE_DELETE(m_leftBuffer);
     SAFE_DELETE(m_rightBuffer);
     SAFE_DELETE(m_resolveBuffer);
+    SAFE_DELETE(m_stereoBuffer);
+    SAFE_DELETE(m_peripheryBuffer);
+    SAFE_DELETE(m_peripheryResolve);
+    SAFE_DELETE(m_centerBuffer);
+    releaseCompositorMirror();
+    qDeleteAll(m_mirrorChain);
+    m_mirrorChain.clear();
+    SAFE_DELETE(m_mirrorBuffer);
+    m_mirrorVAO.destroy();
+    if (m_resolveDepth) {
+        glDeleteTextures(1, &m_resolveDepth);
+        m_resolveDepth = 0;
+    }
+    m_hiddenAreaVAO.destroy();
+    m_hiddenAreaVbo.destroy();
 
-    if(m_hmd){
-        vr::VR_Shutdown();
-        m_hmd = nullptr;
+    if(m_backend){
+        m_backend->shutdown();
+        m_backend.reset();
     }
 }
 
 void VRRender::updatePoses()
 {
-    vr::VRCompositor()->WaitGetPoses(m_trackedDevicePose, vr::k_unMaxTrackedDeviceCount, NULL, 0);
+    m_backend->waitGetPoses(m_trackedDevicePose, vr::k_unMaxTrackedDeviceCount);
+    m_poseLatched = false;
 
     for (unsigned int i=0; i<vr::k_unMaxTrackedDeviceCount; i++)
     {
@@ -238,11 +1195,372 @@ void VRRender::updatePoses()
 
     if (m_trackedDevicePose[vr::k_unTrackedDeviceIndex_Hmd].bPoseIsValid)
     {
-        m_hmdPose = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd].inverted();
+        m_renderPose = m_trackedDevicePose[vr::k_unTrackedDeviceIndex_Hmd].mDeviceToAbsoluteTracking;
+        m_headToWorld = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd];
+        m_hmdPose = m_headToWorld.inverted();
     }
+
+    if (!m_lateLatching)
+        m_telemetry.posePredicted(secondsToPhotons());
+}
+
+/**
+ * 重新预测到本帧上屏时刻的头显位姿; 模型矩阵每次绘制都会重新设置, 这里只需重传Camera块
+ **/
+void VRRender::latchPoses()
+{
+    const float predicted = secondsToPhotons();
+    vr::TrackedDevicePose_t hmd;
+    m_backend->deviceToAbsoluteTrackingPose(vr::TrackingUniverseStanding, predicted, &hmd, 1);
+    if (!hmd.bPoseIsValid)
+        return;
+
+    m_trackedDevicePose[vr::k_unTrackedDeviceIndex_Hmd] = hmd;
+    m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd] = vrMatrixToQt(hmd.mDeviceToAbsoluteTracking);
+    m_renderPose = hmd.mDeviceToAbsoluteTracking;
+    m_headToWorld = m_matrixDevicePose[vr::k_unTrackedDeviceIndex_Hmd];
+    m_hmdPose = m_headToWorld.inverted();
+    m_poseLatched = true;
+    updateCameraBlock();
+
+    m_telemetry.posePredicted(predicted);
+}
+
+/**
+ * 从现在到下一次垂直同步所显示帧发光的时长
+ **/
+float VRRender::secondsToPhotons()
+{
+    float sinceVsync = 0.0f;
+    if (!m_backend->timeSinceLastVsync(&sinceVsync, nullptr))
+        sinceVsync = 0.0f;
+    return qMax(0.0f, m_frameDuration - sinceVsync + m_vsyncToPhotons);
 }
 
 void VRRender::renderEye(vr::Hmd_Eye eye)
+{
+    renderScene(eye, false);
+}
+
+/**
+ * 每帧一次: 两眼的视图/投影矩阵写入Camera块
+ **/
+void VRRender::updateCameraBlock()
+{
+    QMatrix4x4 projection[2] = { m_leftProjection, m_rightProjection };
+    QMatrix4x4 view[2] = { m_leftPose * m_hmdPose, m_rightPose * m_hmdPose };
+    // world-space eye positions for specular lighting
+    QVector4D eyePosition[2] = { view[0].inverted().column(3), view[1].inverted().column(3) };
+
+    m_cameraBlock.set(CAMERA_VIEW, view, 2);
+    m_cameraBlock.set(CAMERA_PROJECTION, projection, 2);
+    m_cameraBlock.set(CAMERA_VIEW_POS, eyePosition, 2);
+    m_cameraBlock.upload();
+}
+
+/**
+ * 单遍立体渲染: 两眼各一个实例, 绘制到双倍宽度的目标
+ **/
+void VRRender::renderStereo()
+{
+    glEnable(GL_MULTISAMPLE);
+    m_stereoBuffer->bind();
+    glViewport(0, 0, m_renderSize.width()*2, m_renderSize.height());
+    glEnable(GL_CLIP_DISTANCE0);
+    renderScene(vr::Eye_Left, true);
+    glDisable(GL_CLIP_DISTANCE0);
+    m_stereoBuffer->release();
+    glViewport(0, 0, m_renderSize.width(), m_renderSize.height());
+}
+
+/**
+ * 多遍渲染到双倍宽度目标: 每眼一个视口, 剪裁测试保证清屏只作用于本眼
+ **/
+void VRRender::renderDoubleWide()
+{
+    glEnable(GL_MULTISAMPLE);
+    m_stereoBuffer->bind();
+    glEnable(GL_SCISSOR_TEST);
+
+    const int width = m_renderSize.width();
+    const int height = m_renderSize.height();
+
+    m_profiler.begin(FrameProfiler::LeftEye);
+    glViewport(0, 0, width, height);
+    glScissor(0, 0, width, height);
+    renderEye(vr::Eye_Left);
+    m_profiler.end(FrameProfiler::LeftEye);
+
+    m_profiler.begin(FrameProfiler::RightEye);
+    glViewport(width, 0, width, height);
+    glScissor(width, 0, width, height);
+    renderEye(vr::Eye_Right);
+    m_profiler.end(FrameProfiler::RightEye);
+
+    glDisable(GL_SCISSOR_TEST);
+    m_stereoBuffer->release();
+    glViewport(0, 0, width, height);
+}
+
+/**
+ * 只保留当前布局需要的MSAA目标, 切换布局或目标尺寸时重新分配
+ **/
+void VRRender::updateEyeTargets(bool doubleWide, bool foveated)
+{
+    const QSize eyeSize = m_targetSize;
+    const QSize stereoSize(eyeSize.width()*2, eyeSize.height());
+
+    QOpenGLFramebufferObjectFormat buffFormat;
+    buffFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+    buffFormat.setInternalTextureFormat(GL_RGBA8);
+    buffFormat.setSamples(EYE_SAMPLES);
+
+    if (m_stereoBuffer && (foveated || !doubleWide || m_stereoBuffer->size() != stereoSize))
+        SAFE_DELETE(m_stereoBuffer);
+    if (m_leftBuffer && (foveated || doubleWide || m_leftBuffer->size() != eyeSize)) {
+        SAFE_DELETE(m_leftBuffer);
+        SAFE_DELETE(m_rightBuffer);
+    }
+    if (foveated) {
+        // the foveation targets replace the eye targets
+        updateFoveationTargets();
+    } else {
+        SAFE_DELETE(m_peripheryBuffer);
+        SAFE_DELETE(m_peripheryResolve);
+        SAFE_DELETE(m_centerBuffer);
+
+        if (doubleWide) {
+            if (!m_stereoBuffer)
+                m_stereoBuffer = new QOpenGLFramebufferObject(stereoSize, buffFormat);
+        } else if (!m_leftBuffer) {
+            m_leftBuffer = new QOpenGLFramebufferObject(eyeSize, buffFormat);
+            m_rightBuffer = new QOpenGLFramebufferObject(eyeSize, buffFormat);
+        }
+    }
+
+    if (!m_resolveBuffer || m_resolveBuffer->size() != stereoSize) {
+        SAFE_DELETE(m_resolveBuffer);
+        QOpenGLFramebufferObjectFormat resolveFormat;
+        resolveFormat.setInternalTextureFormat(GL_RGBA8);
+        m_resolveBuffer = new QOpenGLFramebufferObject(stereoSize, resolveFormat);
+    }
+}
+
+/**
+ * 本帧的渲染区域; 动态分辨率下目标按最大缩放分配, 只渲染其左下角的一部分
+ **/
+void VRRender::updateRenderSize()
+{
+    const QSize eyeSize(m_eyeWidth, m_eyeHeight);
+    float scale = 1.0f;
+    if (m_dynamicResolutionEnabled) {
+        scale = m_dynamicResolution.update(eyeGpuTime());
+        const float maxScale = m_dynamicResolution.maxScale();
+        m_targetSize = QSize(qCeil(eyeSize.width() * maxScale), qCeil(eyeSize.height() * maxScale));
+    } else {
+        m_dynamicResolution.reset();
+        m_targetSize = eyeSize;
+    }
+
+    m_renderSize = QSize(qBound(1, qRound(eyeSize.width() * scale), m_targetSize.width()),
+                         qBound(1, qRound(eyeSize.height() * scale), m_targetSize.height()));
+    m_renderScale = scale;
+}
+
+/**
+ * 提交深度时给解析目标挂一张深度纹理; 解析目标只在尺寸变化时重建, 尺寸变了就重新挂
+ **/
+void VRRender::updateResolveDepth(bool enabled)
+{
+    const QSize size = m_resolveBuffer->size();
+    if (m_resolveDepth && (!enabled || m_resolveDepthSize != size)) {
+        m_resolveBuffer->bind();
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, 0, 0);
+        m_resolveBuffer->release();
+        glDeleteTextures(1, &m_resolveDepth);
+        m_resolveDepth = 0;
+    }
+    if (!enabled || m_resolveDepth)
+        return;
+
+    // unsized like the Depth renderbuffers Qt gives the eye targets, so depth blits match formats
+    glGenTextures(1, &m_resolveDepth);
+    glBindTexture(GL_TEXTURE_2D, m_resolveDepth);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_DEPTH_COMPONENT, size.width(), size.height(), 0,
+                 GL_DEPTH_COMPONENT, GL_UNSIGNED_INT, nullptr);
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_resolveDepthSize = size;
+
+    m_resolveBuffer->bind();
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_resolveDepth, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        qDebug() << "resolve target incomplete with a depth texture";
+    m_resolveBuffer->release();
+}
+
+/**
+ * 两眼共用双倍宽度的解析目标, 以纹理坐标范围区分; 有深度或位姿迟滞更新时附带渲染位姿
+ **/
+void VRRender::submitEyes(bool depth, bool pose)
+{
+    // the rendered part of the double-wide resolve target, v = 0 is the bottom row in OpenGL
+    const float uMax = float(m_renderSize.width()) / (m_targetSize.width() * 2);
+    const float vMax = float(m_renderSize.height()) / m_targetSize.height();
+    const vr::VRTextureBounds_t bounds[2] = {
+        { 0.0f, 0.0f, uMax, vMax },
+        { uMax, 0.0f, uMax * 2.0f, vMax }
+    };
+
+    if (!depth && !pose) {
+        vr::Texture_t composite = { (void*)m_resolveBuffer->texture(), vr::TextureType_OpenGL, vr::ColorSpace_Gamma };
+        m_backend->submit(vr::Eye_Left, &composite, &bounds[vr::Eye_Left]);
+        m_backend->submit(vr::Eye_Right, &composite, &bounds[vr::Eye_Right]);
+        return;
+    }
+
+    // the compositor reprojects from the pose the frame was actually rendered with
+    const vr::EVRSubmitFlags flags = vr::EVRSubmitFlags(vr::Submit_TextureWithPose
+                                                        | (depth ? vr::Submit_TextureWithDepth : 0));
+    for (int eye = vr::Eye_Left; eye <= vr::Eye_Right; ++eye) {
+        vr::VRTextureWithPoseAndDepth_t composite;
+        composite.handle = (void*)m_resolveBuffer->texture();
+        composite.eType = vr::TextureType_OpenGL;
+        composite.eColorSpace = vr::ColorSpace_Gamma;
+        composite.mDeviceToAbsoluteTracking = m_renderPose;
+        composite.depth.handle = depth ? (void*)(uintptr_t)m_resolveDepth : nullptr;
+        composite.depth.mProjection = m_eyeProjection[eye];
+        composite.depth.vRange = { 0.0f, 1.0f };
+        m_backend->submit(vr::Hmd_Eye(eye), &composite, &bounds[eye], flags);
+    }
+}
+
+/**
+ * 最近一帧两眼渲染与解析的GPU耗时, 只统计当前模式实际运行的阶段
+ **/
+float VRRender::eyeGpuTime() const
+{
+    float eyes = 0.0f;
+    if (m_singlePassStereo)
+        eyes = m_profiler.lastGpuTime(FrameProfiler::StereoEyes);
+    else
+        eyes = m_profiler.lastGpuTime(FrameProfiler::LeftEye) + m_profiler.lastGpuTime(FrameProfiler::RightEye);
+    // foveated eyes resolve inside their own stages
+    if (m_foveation && !m_singlePassStereo)
+        return eyes;
+    return eyes + m_profiler.lastGpuTime(FrameProfiler::Resolve);
+}
+
+/**
+ * 注视点渲染所需目标: 低分辨率周边及其解析目标, 全分辨率中心; 两眼共用
+ * 按目标尺寸及最大半径/比例分配, 动态分辨率和注视点参数只改变绘制的子区域
+ **/
+void VRRender::updateFoveationTargets()
+{
+    // the largest radius and peripheral scale are both 1.0, i.e. a whole eye target
+    const QSize peripherySize = m_targetSize;
+    const QSize centerSize = m_targetSize;
+
+    QOpenGLFramebufferObjectFormat buffFormat;
+    buffFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+    buffFormat.setInternalTextureFormat(GL_RGBA8);
+    buffFormat.setSamples(EYE_SAMPLES);
+
+    if (!m_peripheryBuffer || m_peripheryBuffer->size() != peripherySize) {
+        SAFE_DELETE(m_peripheryBuffer);
+        SAFE_DELETE(m_peripheryResolve);
+        m_peripheryBuffer = new QOpenGLFramebufferObject(peripherySize, buffFormat);
+
+        // keeps depth too so it can be scaled into the resolve target when depth is submitted
+        QOpenGLFramebufferObjectFormat resolveFormat;
+        resolveFormat.setAttachment(QOpenGLFramebufferObject::Depth);
+        resolveFormat.setInternalTextureFormat(GL_RGBA8);
+        m_peripheryResolve = new QOpenGLFramebufferObject(peripherySize, resolveFormat);
+    }
+    if (!m_centerBuffer || m_centerBuffer->size() != centerSize) {
+        SAFE_DELETE(m_centerBuffer);
+        m_centerBuffer = new QOpenGLFramebufferObject(centerSize, buffFormat);
+    }
+}
+
+/**
+ * 全分辨率的中心区域, OpenGL像素坐标, 相对于眼睛区域左下角
+ **/
+QRect VRRender::foveationCenter(const QSize &eyeSize) const
+{
+    const float radius = m_foveationInnerRadius;
+    const int width = qMax(1, qRound(eyeSize.width() * radius));
+    const int height = qMax(1, qRound(eyeSize.height() * radius));
+    return QRect((eyeSize.width() - width) / 2, (eyeSize.height() - height) / 2, width, height);
+}
+
+/**
+ * 固定注视点渲染一只眼: 低分辨率绘制整个视场并放大, 再以裁剪后的投影全分辨率绘制中心区域覆盖其上
+ **/
+void VRRender::renderFoveatedEye(vr::Hmd_Eye eye, const QRect &eyeRect, bool depth)
+{
+    // both passes draw into the lower left corner of targets sized for the largest settings
+    const float scale = m_foveationPeripheralScale;
+    const QSize peripherySize(qMax(1, qRound(eyeRect.width() * scale)),
+                              qMax(1, qRound(eyeRect.height() * scale)));
+    const QRect center = foveationCenter(eyeRect.size());
+    const QRect peripheryRect(QPoint(0, 0), peripherySize.boundedTo(m_peripheryBuffer->size()));
+    const QRect centerRect(QPoint(0, 0), center.size().boundedTo(m_centerBuffer->size()));
+
+    // periphery: whole field of view at reduced resolution, upscaled into the eye
+    glEnable(GL_MULTISAMPLE);
+    m_peripheryBuffer->bind();
+    glViewport(0, 0, peripheryRect.width(), peripheryRect.height());
+    renderEye(eye);
+    m_peripheryBuffer->release();
+    const GLbitfield resolveBits = GL_COLOR_BUFFER_BIT | (depth ? GL_DEPTH_BUFFER_BIT : 0);
+    QOpenGLFramebufferObject::blitFramebuffer(m_peripheryResolve, peripheryRect,
+                                              m_peripheryBuffer, peripheryRect, resolveBits);
+    QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, eyeRect,
+                                              m_peripheryResolve, peripheryRect,
+                                              GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    // depth can only be scaled with nearest filtering
+    if (depth)
+        QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, eyeRect,
+                                                  m_peripheryResolve, peripheryRect,
+                                                  GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+
+    // center: the projection is cropped so the center pixels map onto the whole target
+    const float width = eyeRect.width();
+    const float height = eyeRect.height();
+    const float x0 = 2.0f * center.left() / width - 1.0f;
+    const float x1 = 2.0f * (center.left() + center.width()) / width - 1.0f;
+    const float y0 = 2.0f * center.top() / height - 1.0f;
+    const float y1 = 2.0f * (center.top() + center.height()) / height - 1.0f;
+    QMatrix4x4 crop;
+    crop.scale(2.0f / (x1 - x0), 2.0f / (y1 - y0), 1.0f);
+    crop.translate(-(x0 + x1) * 0.5f, -(y0 + y1) * 0.5f, 0.0f);
+
+    QMatrix4x4 projection[2] = { m_leftProjection, m_rightProjection };
+    const int i = eye == vr::Eye_Left ? 0 : 1;
+    projection[i] = crop * projection[i];
+    m_cameraBlock.set(CAMERA_PROJECTION, projection, 2);
+    m_cameraBlock.upload();
+
+    m_centerBuffer->bind();
+    glViewport(0, 0, centerRect.width(), centerRect.height());
+    // the hidden area mesh covers the lens edge, never the center
+    renderScene(eye, false, false);
+    m_centerBuffer->release();
+    // the crop leaves z untouched, so the center depth is in the same range as the periphery
+    QOpenGLFramebufferObject::blitFramebuffer(m_resolveBuffer, center.translated(eyeRect.topLeft()),
+                                              m_centerBuffer, centerRect, resolveBits);
+
+    projection[i] = i == 0 ? m_leftProjection : m_rightProjection;
+    m_cameraBlock.set(CAMERA_PROJECTION, projection, 2);
+    m_cameraBlock.upload();
+    glViewport(0, 0, m_renderSize.width(), m_renderSize.height());
+}
+
+void VRRender::renderScene(vr::Hmd_Eye eye, bool singlePassStereo, bool hiddenArea)
 {
     glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
     glEnable(GL_BLEND);        //启用混合状态
@@ -250,50 +1568,128 @@ void VRRender::renderEye(vr::Hmd_Eye eye)
     glEnable(GL_ALPHA_TEST);  // Enable Alpha Testing (To Make BlackTansparent)
     glAlphaFunc(GL_GREATER, 0.1f);  // Set Alpha Testing (To Make Black Transparent)
 
+    if (m_hiddenAreaMask && hiddenArea)
+        renderHiddenArea(eye, singlePassStereo);
+
+    const int features = ShaderVariants::Instanced | (m_lighting ? ShaderVariants::Lighting : 0);
+    const SceneProgram &scene = sceneProgram(features);
+    if (!scene.program)
+        return;
+
     // be sure to activate shader when setting uniforms/drawing objects
-    lightingShader.bind();
-    lightingShader.setUniformValue("light.position", lightPos);
-
-    QVector4D hmdPosition;
-    QVector4D eyePosition;
-    QMatrix4x4 model, view, projection;
-    model = m_hmdPose.inverted() * model;
-    model.translate(0,0,-CALIB_DEPTH);
-    if(eye == vr::Hmd_Eye::Eye_Left){
-        projection = m_leftProjection;
-        view = m_leftPose * m_hmdPose;
-    } else {
-        projection = m_rightProjection;
-        view = m_rightPose * m_hmdPose;
-    }
-    hmdPosition = m_hmdPose * QVector4D(0.0f, 0.0f, 0.0f, 1.0f);
-    eyePosition = view * QVector4D(0.0f, 0.0f, 0.0f, 1.0f);
+    scene.program->bind();
 
-    lightingShader.setUniformValue("viewPos",  eyePosition);
+    m_passBlock.set(PASS_EYE_INDEX, eye == vr::Eye_Left ? 0 : 1);
+    m_passBlock.set(PASS_SINGLE_PASS_STEREO, singlePassStereo ? 1 : 0);
+    m_passBlock.upload();
 
-    // light properties
-    lightingShader.setUniformValue("light.ambient", QVector3D(0.2f, 0.2f, 0.2f));
-    lightingShader.setUniformValue("light.diffuse", QVector3D(0.5f, 0.5f, 0.5f));
-    lightingShader.setUniformValue("light.specular", QVector3D(1.0f, 1.0f, 1.0f));
+    // targets are placed in head space
+    const QMatrix4x4 &model = m_headToWorld;
+    scene.program->setUniformValue(scene.modelLocation, model);
+    if (scene.normalMatrixLocation >= 0)
+        scene.program->setUniformValue(scene.normalMatrixLocation, model.normalMatrix());
 
-    // material properties
-    lightingShader.setUniformValue("material.shininess", 64.0f);
-    lightingShader.setUniformValue("projection", projection);
-    lightingShader.setUniformValue("view", view);
-    lightingShader.setUniformValue("model", model);
+    // every sprite in one bind, the layer is picked per instance
+    m_sprites.bind(0);
 
-    // bind diffuse map
-    glActiveTexture(GL_TEXTURE0);
-    caliBallTexture->bind();
+    // all targets in one call, each once per eye in single-pass stereo
+    m_targets.draw(singlePassStereo);
+    scene.program->release();
 
-    glActiveTexture(GL_TEXTURE1);
-    ballCenterTexture->bind();
+    if (m_reticle)
+        renderOverlays(singlePassStereo);
+}
+
+/**
+ * 叠加层: 纯色变体绘制缓存的程序化几何体
+ **/
+void VRRender::renderOverlays(bool singlePassStereo)
+{
+    const SceneProgram &flat = sceneProgram(ShaderVariants::FlatColor);
+    if (!flat.program)
+        return;
+
+    flat.program->bind();
+    flat.program->setUniformValue(flat.colorLocation, QVector4D(0.2f, 1.0f, 0.2f, 1.0f));
+    drawCircle(flat, 0.0f, 0.0f, -CALIB_DEPTH, RETICLE_RADIUS, RETICLE_SEGMENTS, singlePassStereo);
+    flat.program->release();
+}
+
+/**
+ * 读取两眼的隐藏区域网格, 上传到同一个VBO并统计遮挡像素比例
+ **/
+void VRRender::loadHiddenAreaMesh()
+{
+    QVector<GLfloat> vertices;
+    float maskedArea = 0.0f;
+    const vr::Hmd_Eye eyes[2] = { vr::Eye_Left, vr::Eye_Right };
+
+    for (int i = 0; i < 2; ++i) {
+        vr::HiddenAreaMesh_t mesh = m_backend->hiddenAreaMesh(eyes[i]);
+        m_hiddenAreaFirst[i] = vertices.size() / 2;
+        m_hiddenAreaCount[i] = mesh.pVertexData ? mesh.unTriangleCount * 3 : 0;
+
+        for (int t = 0; t < m_hiddenAreaCount[i]; t += 3) {
+            const vr::HmdVector2_t *v = mesh.pVertexData + t;
+            maskedArea += qAbs((v[1].v[0] - v[0].v[0]) * (v[2].v[1] - v[0].v[1]) -
+                               (v[2].v[0] - v[0].v[0]) * (v[1].v[1] - v[0].v[1])) * 0.5f;
+            for (int k = 0; k < 3; ++k)
+                vertices << v[k].v[0] << v[k].v[1];
+        }
+    }
+    m_maskedPixelFraction = qBound(0.0f, maskedArea / 2.0f, 1.0f);
+    qDebug() << "hidden area mesh masks" << m_maskedPixelFraction * 100.0f << "% of eye pixels";
+
+    if (vertices.isEmpty())
+        return;
 
-    {// render the cube
-        QOpenGLVertexArrayObject::Binder vaoBind(&cubeVAO);
-        glDrawArrays(GL_TRIANGLES, 0, 36);
+    bool success = m_hiddenAreaShader.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shader/hidden_area.vert");
+    success = success && m_hiddenAreaShader.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shader/hidden_area.frag");
+    success = success && m_hiddenAreaShader.link();
+    if (!success) {
+        qDebug() << "hidden area shader failed!" << m_hiddenAreaShader.log();
+        m_hiddenAreaCount[0] = m_hiddenAreaCount[1] = 0;
+        return;
     }
-    lightingShader.release();
+
+    m_hiddenAreaVbo.create();
+    m_hiddenAreaVbo.bind();
+    m_hiddenAreaVbo.allocate(vertices.constData(), vertices.size() * sizeof(GLfloat));
+    {
+        QOpenGLVertexArrayObject::Binder vaoBind(&m_hiddenAreaVAO);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 2 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+    }
+    m_hiddenAreaVbo.release();
+}
+
+/**
+ * 深度预渲染: 隐藏区域写入最近深度, 被遮挡像素在着色前即被剔除
+ **/
+void VRRender::renderHiddenArea(vr::Hmd_Eye eye, bool singlePassStereo)
+{
+    if (!m_hiddenAreaCount[0] && !m_hiddenAreaCount[1])
+        return;
+
+    glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+    m_hiddenAreaShader.bind();
+    {
+        QOpenGLVertexArrayObject::Binder vaoBind(&m_hiddenAreaVAO);
+        if (singlePassStereo) {
+            const int width = m_renderSize.width();
+            const int height = m_renderSize.height();
+            glViewport(0, 0, width, height);
+            glDrawArrays(GL_TRIANGLES, m_hiddenAreaFirst[0], m_hiddenAreaCount[0]);
+            glViewport(width, 0, width, height);
+            glDrawArrays(GL_TRIANGLES, m_hiddenAreaFirst[1], m_hiddenAreaCount[1]);
+            glViewport(0, 0, width*2, height);
+        } else {
+            const int i = eye == vr::Eye_Left ? 0 : 1;
+            glDrawArrays(GL_TRIANGLES, m_hiddenAreaFirst[i], m_hiddenAreaCount[i]);
+        }
+    }
+    m_hiddenAreaShader.release();
+    glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
 }
 
 QMatrix4x4 VRRender::vrMatrixToQt(const vr::HmdMatrix34_t &mat)
@@ -331,42 +1727,91 @@ QMatrix4x4 VRRender::viewProjection(vr::Hmd_Eye eye)
 
 QString VRRender::getTrackedDeviceString(vr::TrackedDeviceIndex_t device, vr::TrackedDeviceProperty prop, vr::TrackedPropertyError *error)
 {
-    uint32_t len = m_hmd->GetStringTrackedDeviceProperty(device, prop, NULL, 0, error);
-    if(len == 0)
-        return "";
-
-    char *buf = new char[len];
-    m_hmd->GetStringTrackedDeviceProperty(device, prop, buf, len, error);
-
-    QString result = QString::fromLocal8Bit(buf);
-    delete [] buf;
-
-    return result;
+    return m_backend->trackedDeviceString(device, prop, error);
 }
 
-QVector<GLfloat> VRRender::drawCircle(float x, float y, float z, float r, int lineSegmentCount)
+/**
+ * 头部空间中以(x, y, z)为圆心, r为半径的圆; 网格按线段数缓存, 只随模型矩阵缩放
+ **/
+void VRRender::drawCircle(const SceneProgram &scene, float x, float y, float z, float r, int lineSegmentCount,
+                          bool singlePassStereo)
 {
-    return QVector<GLfloat>();
+    QMatrix4x4 model = m_headToWorld;
+    model.translate(x, y, z);
+    model.scale(r);
+    scene.program->setUniformValue(scene.modelLocation, model);
+    m_primitives.draw(m_primitives.circle(lineSegmentCount), singlePassStereo);
 }
 
-bool VRRender::createShader()
+/**
+ * 创建uniform块并挂到每个场景变体上; 光照与材质为常量, 只上传一次
+ **/
+void VRRender::initUniformBlocks()
 {
-    bool success = lightingShader.addShaderFromSourceFile(QOpenGLShader::Vertex, ":/shader/shader.vert");
-    if (!success) {
-        qDebug() << "shaderProgram addShaderFromSourceFile failed!" << lightingShader.log();
-        return success;
-    }
+    QOpenGLExtraFunctions *gl = m_openGLContext.extraFunctions();
+    // the lit instanced variant declares every block
+    QOpenGLShaderProgram *lit = sceneProgram(ShaderVariants::Lighting | ShaderVariants::Instanced).program;
+    if (!lit)
+        return;
 
-    success = lightingShader.addShaderFromSourceFile(QOpenGLShader::Fragment, ":/shader/shader.frag");
-    if (!success) {
-        qDebug() << "shaderProgram addShaderFromSourceFile failed!" << lightingShader.log();
-        return success;
+    m_cameraBlock.init(gl, lit, "Camera", CAMERA_BINDING,
+                       { "view[0]", "projection[0]", "viewPos[0]" });
+    m_passBlock.init(gl, lit, "Pass", PASS_BINDING,
+                     { "eyeIndex", "singlePassStereo" });
+    m_lightingBlock.init(gl, lit, "Lighting", LIGHTING_BINDING,
+                         { "lightPosition", "lightAmbient", "lightDiffuse", "lightSpecular", "shininess" });
+    for (int features : SCENE_VARIANTS) {
+        if (QOpenGLShaderProgram *program = sceneProgram(features).program) {
+            m_cameraBlock.attach(program);
+            m_passBlock.attach(program);
+            m_lightingBlock.attach(program);
+        }
     }
 
-    success = lightingShader.link();
-    if(!success) {
-        qDebug() << "shaderProgram link failed!" << lightingShader.log();
-    }
+    const QVector4D light[4] = { QVector4D(lightPos, 1.0f),
+                                 QVector4D(0.2f, 0.2f, 0.2f, 0.0f),
+                                 QVector4D(0.5f, 0.5f, 0.5f, 0.0f),
+                                 QVector4D(1.0f, 1.0f, 1.0f, 0.0f) };
+    m_lightingBlock.set(LIGHT_POSITION, &light[0]);
+    m_lightingBlock.set(LIGHT_AMBIENT, &light[1]);
+    m_lightingBlock.set(LIGHT_DIFFUSE, &light[2]);
+    m_lightingBlock.set(LIGHT_SPECULAR, &light[3]);
+    m_lightingBlock.set(MATERIAL_SHININESS, 64.0f);
+    m_lightingBlock.upload();
+}
 
+/**
+ * 预先编译所有场景变体, 避免渲染中途切换时卡顿
+ **/
+bool VRRender::createShader()
+{
+    bool success = true;
+    for (int features : SCENE_VARIANTS)
+        success = sceneProgram(features).program != nullptr && success;
     return success;
 }
+
+/**
+ * 取场景变体, 首次使用时编译并缓存uniform位置
+ **/
+const VRRender::SceneProgram &VRRender::sceneProgram(int features)
+{
+    auto it = m_scenePrograms.constFind(features);
+    if (it != m_scenePrograms.constEnd())
+        return it.value();
+
+    SceneProgram scene;
+    scene.program = m_sceneShaders.program(features);
+    if (scene.program) {
+        scene.modelLocation = scene.program->uniformLocation("model");
+        scene.normalMatrixLocation = scene.program->uniformLocation("normalMatrix");
+        scene.colorLocation = scene.program->uniformLocation("flatColor");
+
+        // shader configuration
+        // --------------------
+        scene.program->bind();
+        scene.program->setUniformValue("sprites", 0);
+        scene.program->release();
+    }
+    return *m_scenePrograms.insert(features, scene);
+}
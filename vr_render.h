@@ -2,45 +2,268 @@
 #define VRRENDER_H
 
 #include <QObject>
+#include <QElapsedTimer>
 #include <QImage>
 #include <QOffscreenSurface>
-#include <QOpenGLFunctions>
+#include <QOpenGLExtraFunctions>
 #include <QOpenGLTexture>
 #include <QOpenGLFramebufferObject>
 #include <QOpenGLShaderProgram>
 #include <QOpenGLBuffer>
 #include <QOpenGLVertexArrayObject>
+#include <QThread>
+#include <atomic>
 #include "openvr.h"
+#include "vr_backend.h"
+#include "compositor_telemetry.h"
+#include "dynamic_resolution.h"
+#include "frame_profiler.h"
+#include "mirror_readback.h"
+#include "primitive_cache.h"
+#include "shader_variants.h"
+#include "sprite_atlas.h"
+#include "target_renderer.h"
+#include "triple_buffer.h"
+#include "uniform_block.h"
 
-class VRRender : public QObject, QOpenGLFunctions
+class VRRender : public QObject, QOpenGLExtraFunctions
 {
     Q_OBJECT
     Q_PROPERTY(QImage frame READ frame NOTIFY frameChanged)
+    Q_PROPERTY(int frameSequence READ frameSequence NOTIFY frameChanged)
     Q_PROPERTY(QSize frameSize READ frameSize NOTIFY frameSizeChanged)
+    Q_PROPERTY(QVariantList profile READ profile NOTIFY profileChanged)
+    Q_PROPERTY(QVariantMap compositorStats READ compositorStats NOTIFY compositorStatsChanged)
+    Q_PROPERTY(bool running READ running WRITE setRunning NOTIFY runningChanged)
+    Q_PROPERTY(bool sharedTexture READ sharedTexture CONSTANT)
+    Q_PROPERTY(bool singlePassStereo READ singlePassStereo WRITE setSinglePassStereo NOTIFY singlePassStereoChanged)
+    Q_PROPERTY(bool doubleWideTarget READ doubleWideTarget WRITE setDoubleWideTarget NOTIFY doubleWideTargetChanged)
+    Q_PROPERTY(bool dynamicResolution READ dynamicResolution WRITE setDynamicResolution NOTIFY dynamicResolutionChanged)
+    Q_PROPERTY(float renderScale READ renderScale NOTIFY renderScaleChanged)
+    Q_PROPERTY(bool foveation READ foveation WRITE setFoveation NOTIFY foveationChanged)
+    Q_PROPERTY(float foveationInnerRadius READ foveationInnerRadius WRITE setFoveationInnerRadius NOTIFY foveationInnerRadiusChanged)
+    Q_PROPERTY(float foveationPeripheralScale READ foveationPeripheralScale WRITE setFoveationPeripheralScale NOTIFY foveationPeripheralScaleChanged)
+    Q_PROPERTY(bool submitDepth READ submitDepth WRITE setSubmitDepth NOTIFY submitDepthChanged)
+    Q_PROPERTY(bool lateLatching READ lateLatching WRITE setLateLatching NOTIFY lateLatchingChanged)
+    Q_PROPERTY(bool hiddenAreaMask READ hiddenAreaMask WRITE setHiddenAreaMask NOTIFY hiddenAreaMaskChanged)
+    Q_PROPERTY(bool lighting READ lighting WRITE setLighting NOTIFY lightingChanged)
+    Q_PROPERTY(bool reticle READ reticle WRITE setReticle NOTIFY reticleChanged)
+    Q_PROPERTY(float maskedPixelFraction READ maskedPixelFraction CONSTANT)
+    Q_PROPERTY(int readbackDepth READ readbackDepth WRITE setReadbackDepth NOTIFY readbackDepthChanged)
+    Q_PROPERTY(int readbackRingSize READ readbackRingSize WRITE setReadbackRingSize NOTIFY readbackRingSizeChanged)
+    Q_PROPERTY(QSize mirrorSize READ mirrorSize WRITE setMirrorSize NOTIFY mirrorSizeChanged)
+    Q_PROPERTY(MirrorMode mirrorMode READ mirrorMode WRITE setMirrorMode NOTIFY mirrorModeChanged)
+    Q_PROPERTY(bool compositorMirror READ compositorMirror WRITE setCompositorMirror NOTIFY compositorMirrorChanged)
 
 
 public:
+    // layers of the sprite atlas, in the order they are packed
+    enum Sprite {
+        Point,
+        RedPoint,
+        GreenPoint
+    };
+    Q_ENUM(Sprite)
+
+    // what the desktop mirror shows, all taken from the resolve target
+    enum MirrorMode {
+        LeftEye,
+        RightEye,
+        SideBySide,
+        Anaglyph,
+        Composite
+    };
+    Q_ENUM(MirrorMode)
+
     explicit VRRender(QObject *parent = nullptr);
     ~VRRender();
 
+    static void setBackendName(const QString &name);
+
+    static void setSpriteAtlasPath(const QString &path);
+
+    Q_INVOKABLE QVariantMap backendStatistics() const;
+
+    Q_INVOKABLE QString dumpProfile() const;
+
+    // construction and cold-start-to-first-frame timings in milliseconds
+    Q_INVOKABLE QVariantMap startupStatistics() const;
+
+    // calibration targets, positions in head space; safe to call while rendering
+    Q_INVOKABLE int addTarget(const QVector3D &position, float scale = 1.0f, int sprite = 0);
+    Q_INVOKABLE void moveTarget(int id, const QVector3D &position);
+    Q_INVOKABLE void highlightTarget(int id, bool highlighted = true);
+    Q_INVOKABLE void removeTarget(int id);
+
     QImage frame() const;
 
+    int frameSequence() const;
+
     QSize frameSize() const;
 
+    QVariantList profile() const;
+
+    QVariantMap compositorStats() const;
+
+    int readbackDepth() const;
+
+    int readbackRingSize() const;
+
+    QSize mirrorSize() const;
+
+    MirrorMode mirrorMode() const;
+
+    bool compositorMirror() const;
+
+    bool running() const;
+
+    bool sharedTexture() const;
+
+    bool singlePassStereo() const;
+
+    bool doubleWideTarget() const;
+
+    bool dynamicResolution() const;
+
+    float renderScale() const;
+
+    bool foveation() const;
+
+    float foveationInnerRadius() const;
+
+    float foveationPeripheralScale() const;
+
+    bool submitDepth() const;
+
+    bool lateLatching() const;
+
+    bool hiddenAreaMask() const;
+
+    float maskedPixelFraction() const;
+
+    bool lighting() const;
+
+    bool reticle() const;
+
+    // shared-context mirror texture, called by MirrorView on the scene graph thread
+    void attachSharedFrameConsumer();
+    void detachSharedFrameConsumer();
+    bool acquireSharedFrame(GLuint &textureId, QSize &size);
+    void fenceSharedFrame();
+
 public slots:
 
-    void renderImage();
+    void setRunning(bool running);
+
+    void requestFrame();
+
+    void setSinglePassStereo(bool singlePassStereo);
+
+    void setDoubleWideTarget(bool doubleWideTarget);
+
+    void setDynamicResolution(bool dynamicResolution);
+
+    void setFoveation(bool foveation);
+
+    void setFoveationInnerRadius(float foveationInnerRadius);
+
+    void setFoveationPeripheralScale(float foveationPeripheralScale);
+
+    void setSubmitDepth(bool submitDepth);
+
+    void setLateLatching(bool lateLatching);
+
+    void setHiddenAreaMask(bool hiddenAreaMask);
+
+    void setLighting(bool lighting);
+
+    void setReticle(bool reticle);
+
+    void setReadbackDepth(int readbackDepth);
+
+    void setReadbackRingSize(int readbackRingSize);
+
+    void setMirrorSize(const QSize &mirrorSize);
+
+    void setMirrorMode(MirrorMode mirrorMode);
+
+    void setCompositorMirror(bool compositorMirror);
 
 signals:
     void frameChanged(QImage frame);
     void frameSizeChanged(QSize frameSize);
+    void profileChanged(QVariantList profile);
+    void compositorStatsChanged(QVariantMap compositorStats);
+    void readbackDepthChanged(int readbackDepth);
+    void readbackRingSizeChanged(int readbackRingSize);
+    void mirrorSizeChanged(QSize mirrorSize);
+    void mirrorModeChanged(MirrorMode mirrorMode);
+    void compositorMirrorChanged(bool compositorMirror);
+    void runningChanged(bool running);
+    void sharedFrameChanged();
+    void singlePassStereoChanged(bool singlePassStereo);
+    void doubleWideTargetChanged(bool doubleWideTarget);
+    void dynamicResolutionChanged(bool dynamicResolution);
+    void renderScaleChanged(float renderScale);
+    void foveationChanged(bool foveation);
+    void foveationInnerRadiusChanged(float foveationInnerRadius);
+    void foveationPeripheralScaleChanged(float foveationPeripheralScale);
+    void submitDepthChanged(bool submitDepth);
+    void lateLatchingChanged(bool lateLatching);
+    void hiddenAreaMaskChanged(bool hiddenAreaMask);
+    void lightingChanged(bool lighting);
+    void reticleChanged(bool reticle);
+
+protected:
+    void connectNotify(const QMetaMethod &signal) override;
+    void disconnectNotify(const QMetaMethod &signal) override;
+
+private slots:
+    void onFrameReady();
 
 private:
+    struct SceneProgram
+    {
+        QOpenGLShaderProgram *program = nullptr;
+        GLint modelLocation = -1;
+        GLint normalMatrixLocation = -1;
+        GLint colorLocation = -1;
+    };
+
     void initGL();
     void initVR();
     void release();
+    void renderLoop();
+    void renderImage();
+    bool createMirrorShader();
+    QOpenGLFramebufferObject *mirrorSource(QRect &rect);
+    void drawMirror(int mode, GLuint leftTexture, GLuint rightTexture,
+                    const QVector4D &leftRect, const QVector4D &rightRect, const QSize &size);
+    QOpenGLFramebufferObject *compositorMirrorSource(int mode, QRect &rect);
+    bool acquireCompositorMirror(vr::Hmd_Eye eye);
+    void releaseCompositorMirror();
+    QOpenGLFramebufferObject *downscaleMirror(QOpenGLFramebufferObject *source, QRect &rect);
+    void publishSharedFrame(QOpenGLFramebufferObject *source, const QRect &sourceRect);
+    void readbackFrame(QOpenGLFramebufferObject *source, const QRect &sourceRect, bool paced);
+    void notifyFrameReady();
     void updatePoses();
     void renderEye(vr::Hmd_Eye eye);
+    void renderStereo();
+    void renderDoubleWide();
+    void updateEyeTargets(bool doubleWide, bool foveated);
+    void updateRenderSize();
+    float eyeGpuTime() const;
+    void renderScene(vr::Hmd_Eye eye, bool singlePassStereo, bool hiddenArea = true);
+    void renderFoveatedEye(vr::Hmd_Eye eye, const QRect &eyeRect, bool depth);
+    void updateResolveDepth(bool enabled);
+    void submitEyes(bool depth, bool pose);
+    void latchPoses();
+    float secondsToPhotons();
+    void updateFoveationTargets();
+    QRect foveationCenter(const QSize &eyeSize) const;
+    void renderOverlays(bool singlePassStereo);
+    void loadHiddenAreaMesh();
+    void renderHiddenArea(vr::Hmd_Eye eye, bool singlePassStereo);
 
     QMatrix4x4 vrMatrixToQt(const vr::HmdMatrix34_t &mat);
     QMatrix4x4 vrMatrixToQt(const vr::HmdMatrix44_t &mat);
@@ -54,41 +277,161 @@ private:
                                    vr::TrackedDeviceProperty prop,
                                    vr::TrackedPropertyError *error = 0);
 
-    QVector<GLfloat> drawCircle(float x, float y, float z, float r, int lineSegmentCount);
+    void drawCircle(const SceneProgram &scene, float x, float y, float z, float r, int lineSegmentCount,
+                    bool singlePassStereo);
 
     bool createShader();
+    const SceneProgram &sceneProgram(int features);
+    void initUniformBlocks();
+    void updateCameraBlock();
 
 private:
     QImage m_frame;
+    int m_frameSequence;
     QSize m_frameSize;
     float m_aspectRatio;
-    int m_frameCount;
+    quint64 m_frameCount;
 
     //OpenGL
     QSurfaceFormat m_surfaceFormat;
     QOffscreenSurface m_surface;
     QOpenGLContext m_openGLContext;
 
-    QOpenGLShaderProgram lightingShader;
+    // shader.vert/shader.frag, one program per ShaderVariants feature set
+    ShaderVariants m_sceneShaders;
+    QHash<int, SceneProgram> m_scenePrograms;
     QOpenGLBuffer vbo{QOpenGLBuffer::VertexBuffer};
-    QOpenGLVertexArrayObject cubeVAO;
-    std::unique_ptr<QOpenGLTexture> caliBallTexture;
-    std::unique_ptr<QOpenGLTexture> ballCenterTexture;
+    TargetRenderer m_targets;
+    PrimitiveCache m_primitives;
+    static QString s_spriteAtlasPath;
+    SpriteAtlas m_sprites;
+
+    //Startup
+    QElapsedTimer m_startupClock;
+    QVariantMap m_startupStatistics;
+    std::atomic<qint64> m_firstFrameNs;
+    UniformBlock m_cameraBlock;
+    UniformBlock m_passBlock;
+    UniformBlock m_lightingBlock;
 
     //OpenVR
-    vr::IVRSystem *m_hmd;
+    static QString s_backendName;
+    std::unique_ptr<VRBackend> m_backend;
     vr::TrackedDevicePose_t m_trackedDevicePose[vr::k_unMaxTrackedDeviceCount];
     QMatrix4x4 m_matrixDevicePose[vr::k_unMaxTrackedDeviceCount];
 
     QMatrix4x4 m_leftProjection, m_leftPose;
     QMatrix4x4 m_rightProjection, m_rightPose;
     QMatrix4x4 m_hmdPose;
+    QMatrix4x4 m_headToWorld;
+    // raw projections and the HMD pose the frame was rendered with, for depth submission
+    vr::HmdMatrix44_t m_eyeProjection[2];
+    vr::HmdMatrix34_t m_renderPose;
 
     QOpenGLFramebufferObject *m_leftBuffer;
     QOpenGLFramebufferObject *m_rightBuffer;
     QOpenGLFramebufferObject *m_resolveBuffer;
+    QOpenGLFramebufferObject *m_stereoBuffer;
 
     uint32_t m_eyeWidth, m_eyeHeight;
+    // per-eye size the targets are allocated with, and the part of it rendered this frame
+    QSize m_targetSize;
+    QSize m_renderSize;
+
+    //Dynamic resolution
+    DynamicResolution m_dynamicResolution;
+    std::atomic<bool> m_dynamicResolutionEnabled;
+    std::atomic<float> m_renderScale;
+    float m_publishedRenderScale;
+
+    //Fixed foveation
+    std::atomic<bool> m_foveation;
+    std::atomic<float> m_foveationInnerRadius;
+    std::atomic<float> m_foveationPeripheralScale;
+    QOpenGLFramebufferObject *m_peripheryBuffer;
+    QOpenGLFramebufferObject *m_peripheryResolve;
+    QOpenGLFramebufferObject *m_centerBuffer;
+
+    //Depth submission
+    std::atomic<bool> m_submitDepth;
+    GLuint m_resolveDepth;
+    QSize m_resolveDepthSize;
+
+    //Late latching
+    std::atomic<bool> m_lateLatching;
+    float m_frameDuration;
+    float m_vsyncToPhotons;
+    bool m_poseLatched;
+
+    MirrorReadback m_mirrorReadback;
+
+    //Profiling
+    FrameProfiler m_profiler;
+    TripleBuffer<QVariantList> m_profileBuffer;
+    QVariantList m_profile;
+
+    //Compositor telemetry
+    CompositorTelemetry m_telemetry;
+    TripleBuffer<QVariantMap> m_telemetryBuffer;
+    QVariantMap m_compositorStats;
+
+    //Render thread
+    std::unique_ptr<QThread> m_renderThread;
+    std::atomic<bool> m_running;
+    std::atomic<bool> m_frameNotifyPending;
+    std::atomic<int> m_readbackDepth;
+    std::atomic<int> m_readbackRingSize;
+    TripleBuffer<QImage> m_frameBuffer;
+    std::atomic<bool> m_readbackEnabled;
+    // back-pressure from a consumer that calls requestFrame() once it has shown a frame
+    std::atomic<bool> m_framePaced;
+    std::atomic<bool> m_frameWanted;
+
+    //Mirror downscale, sized to the view in device pixels
+    std::atomic<int> m_mirrorWidth;
+    std::atomic<int> m_mirrorHeight;
+    QVector<QOpenGLFramebufferObject*> m_mirrorChain;
+
+    //Mirror content
+    std::atomic<int> m_mirrorMode;
+    QOpenGLShaderProgram m_mirrorShader;
+    QOpenGLVertexArrayObject m_mirrorVAO;
+    QOpenGLFramebufferObject *m_mirrorBuffer;
+
+    //Compositor mirror, post-distortion, per eye
+    std::atomic<bool> m_compositorMirror;
+    vr::glUInt_t m_compositorMirrorTexture[2];
+    vr::glSharedTextureHandle_t m_compositorMirrorHandle[2];
+    QSize m_compositorMirrorSize[2];
+    bool m_compositorMirrorFailed;
+
+    //Shared-context mirror
+    struct SharedFrame
+    {
+        QOpenGLFramebufferObject *buffer = nullptr;
+        GLuint textureId = 0;
+        QSize size;
+        GLsync fence = nullptr;
+        // signalled once the consumer context no longer samples the texture
+        GLsync readFence = nullptr;
+    };
+    TripleBuffer<SharedFrame> m_sharedFrames;
+    std::atomic<int> m_sharedFrameConsumers;
+    std::atomic<bool> m_sharedFramePending;
+
+    std::atomic<bool> m_singlePassStereo;
+    std::atomic<bool> m_doubleWideTarget;
+    std::atomic<bool> m_lighting;
+    std::atomic<bool> m_reticle;
+
+    //Hidden area mesh
+    QOpenGLShaderProgram m_hiddenAreaShader;
+    QOpenGLBuffer m_hiddenAreaVbo{QOpenGLBuffer::VertexBuffer};
+    QOpenGLVertexArrayObject m_hiddenAreaVAO;
+    int m_hiddenAreaFirst[2] = {0, 0};
+    int m_hiddenAreaCount[2] = {0, 0};
+    std::atomic<bool> m_hiddenAreaMask;
+    float m_maskedPixelFraction;
 
 };
 